@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <signal.h>
 #include <time.h>
+#include <stdint.h>
 
 #define CLOCKID CLOCK_MONOTONIC
 #define SIG SIGRTMIN
@@ -75,6 +76,24 @@ public:
 	}
 
 protected:
+	// how many ns the current event fired after the timer was due,
+	// to be called from timerEvent()
+	// (64 bit so that periods of 2s and more don't overflow a 32 bit long)
+	int64_t getEventLatency() {
+		struct itimerspec cur;
+		if (timer_gettime(timerid, &cur) == -1) return 0;
+		const int64_t period = (int64_t)its.it_interval.tv_sec * 1000000000 + its.it_interval.tv_nsec;
+		const int64_t left = (int64_t)cur.it_value.tv_sec * 1000000000 + cur.it_value.tv_nsec;
+		return period > left ? period - left : 0;
+	}
+
+	// number of events which have been missed before the current one
+	// because it was still being handled, to be called from timerEvent()
+	int getOverrun() {
+		const int n = timer_getoverrun(timerid);
+		return n > 0 ? n : 0;
+	}
+
 	// is implemented by its children
 	// this is exectuted once "start" has been called
 	virtual void timerEvent() = 0;
@@ -23,30 +23,37 @@ Distributed as-is; no warranty is given.
 ******************************************************************************/
 
 #include <time.h>
+#include <string>
+#include <math.h>
 #include <unistd.h>
 #include <wiringPi.h>
-#include <wiringPiI2C.h>
 #include "LSM9DS1.h"
 #include "LSM9DS1_Registers.h"
+#include "LSM9DS1_Trace.h"
 #include "LSM9DS1_Types.h"
 
-float magSensitivity[4] = {0.00014, 0.00029, 0.00043, 0.00058};
-
 LSM9DS1::LSM9DS1()
 {
+    if (wiringPiSetupGpio() == -1)
+        return;
     init(IMU_MODE_I2C, LSM9DS1_AG_ADDR(1), LSM9DS1_M_ADDR(1));
 }
 
 LSM9DS1::LSM9DS1(interface_mode interface, uint8_t xgAddr, uint8_t mAddr)
 {
+    if (wiringPiSetupGpio() == -1)
+        return;
     init(interface, xgAddr, mAddr);
 }
 
-void LSM9DS1::init(interface_mode interface, uint8_t xgAddr, uint8_t mAddr)
+LSM9DS1::LSM9DS1(LSM9DS1transport& transport, uint8_t xgAddr, uint8_t mAddr)
 {
-    if (wiringPiSetupGpio() == -1)
-        return;
+    _transport = &transport;
+    init(IMU_MODE_I2C, xgAddr, mAddr);
+}
 
+void LSM9DS1::init(interface_mode interface, uint8_t xgAddr, uint8_t mAddr)
+{
     settings.device.commInterface = interface;
     settings.device.agAddress = xgAddr;
     settings.device.mAddress = mAddr;
@@ -138,6 +145,7 @@ void LSM9DS1::init(interface_mode interface, uint8_t xgAddr, uint8_t mAddr)
 
 uint16_t LSM9DS1::begin()
 {
+    LSM9DS1transportOperation operation(_transport, "begin");
 
     //! Todo: don't use _xgAddress or _mAddress, duplicating memory
     _xgAddress = settings.device.agAddress;
@@ -172,26 +180,259 @@ uint16_t LSM9DS1::begin()
     calibrate();
 
     // 20ms => 50Hz
-    start(20*1000*1000);
+    start(_timerPeriod);
     return whoAmICombined;
 }
 
 
+#ifdef LSM9DS1_LATENCY
+// Adds the time until the end of the scope to an accumulator
+class LatencyScope {
+public:
+    LatencyScope(uint64_t& acc) : acc(acc), t0(LSM9DS1latency::now()) {}
+    ~LatencyScope() { acc += LSM9DS1latency::now() - t0; }
+private:
+    uint64_t& acc;
+    const uint64_t t0;
+};
+
+// Records the wakeup latency of a timer event and, when it returns,
+// the bus and callback time spent in it
+class LatencyTick {
+public:
+    LatencyTick(LSM9DS1latency& latency, uint64_t& busNs, uint64_t& callbackNs, int64_t late)
+        : latency(latency), busNs(busNs), callbackNs(callbackNs) {
+        busNs = 0;
+        callbackNs = 0;
+        latency.wakeup.record(late);
+    }
+    ~LatencyTick() {
+        latency.bus.record(busNs);
+        latency.callback.record(callbackNs);
+    }
+private:
+    LSM9DS1latency& latency;
+    uint64_t& busNs;
+    uint64_t& callbackNs;
+};
+
+#define LSM9DS1_TIME_SCOPE(acc) LatencyScope latencyScope(acc)
+#define LSM9DS1_TIME_TICK() LatencyTick latencyTick(latency, _busNs, _callbackNs, getEventLatency())
+#else
+#define LSM9DS1_TIME_SCOPE(acc)
+#define LSM9DS1_TIME_TICK()
+#endif
+
+// Gyro/accel output data rates in Hz, indexed by the ODR setting
+static const double xgODRHz[7] = {0, 14.9, 59.5, 119, 238, 476, 952};
+
+static uint64_t odrPeriod(uint8_t rate)
+{
+    if ((rate < 1) || (rate > 6)) rate = 6;
+    return (uint64_t)(1e9 / xgODRHz[rate]);
+}
+
 void LSM9DS1::timerEvent() {
-	if (!lsm9ds1Callback) return;
-		readGyro();
-		readAccel();
-		readMag();
-		lsm9ds1Callback->hasSample(
-					   calcGyro(gx),
-					   calcGyro(gy),
-					   calcGyro(gz),
-					   calcAccel(ax),
-					   calcAccel(ay),
-					   calcAccel(az),
-					   calcMag(mx),
-					   calcMag(my),
-					   calcMag(mz));
+	if ((!lsm9ds1Callback) && (!sampleSink)) return;
+		LSM9DS1_TRACE_SCOPE("timerEvent");
+		LSM9DS1_TIME_TICK();
+		LSM9DS1transportOperation operation(_transport, "timerEvent");
+		const int missed = getOverrun();
+		if (missed) {
+			_missedTicks += missed;
+			if (_mMissedTicks) _mMissedTicks->inc(missed);
+			// The FIFO keeps the samples of missed events
+			if ((!_burstTriggers) && (!_streamRate)) _gap = true;
+		}
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		const uint64_t now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+		// Only the bus transfers are in the try block, the samples are
+		// delivered after it
+		try {
+			acquire(now);
+			// Between this read and the next one
+			applyCommands();
+			if (_busFailed) {
+				_busFailed = false;
+				if (_mRecoveries) _mRecoveries->inc();
+			}
+		} catch (int) {
+			// A failed bus read: end this event and try again at the next
+			_busFailed = true;
+			_gap = true;
+			if (_mBusErrors) _mBusErrors->inc();
+		}
+		deliverPending();
+#ifdef LSM9DS1_LATENCY
+		if (_mBusTime) _mBusTime->inc(_busNs);
+#endif
+}
+
+void LSM9DS1::acquire(uint64_t now)
+{
+    if (_burstTriggers) {
+        burstCaptureEvent(now);
+        return;
+    }
+    if (_streamRate) {
+        readMag();
+        const uint8_t n = readFIFOLevel();
+        const unsigned first = _nPending;
+        drainFIFO(n, now, odrPeriod(_streamRate), _odrChanged ? 0 : n);
+        if (_autoRangeAccel || _autoRangeGyro) {
+            // The entries after a switch were still taken at the old scale
+            for (unsigned i = first; i < _nPending; i++)
+                if (autoRange(_pending[i], _pending[i].timestamp)) break;
+        }
+        return;
+    }
+    if (_dutyCycling) {
+        // STATUS_REG_1 INACT: the inactivity generator has fired
+        const bool inactive = xgReadByte(STATUS_REG_1) & (1<<4);
+        if (inactive != _stationary) {
+            _stationary = inactive;
+            _activityChanged = true;
+            start(inactive ? _idlePeriod : _timerPeriod);
+        }
+    }
+    if (_stationary) {
+        gx = gy = gz = 0;
+    } else {
+        readGyroRaw();
+    }
+    readAccelRaw();
+    readMag();
+    LSM9DS1sample sample;
+    fillSample(sample, now);
+    if (_pollAccelInt && getAccelIntSrc()) sample.flags |= SAMPLE_ACCEL_INT;
+    if (_stationary) sample.flags |= SAMPLE_INACTIVE;
+    if (_activityChanged) {
+        sample.flags |= SAMPLE_ACTIVITY_CHANGE;
+        _activityChanged = false;
+    }
+    queue(sample);
+    if ((_autoRangeAccel || _autoRangeGyro) && !_stationary) autoRange(sample, now);
+}
+
+void LSM9DS1::applyCommands()
+{
+    LSM9DS1command commands[LSM9DS1commandQueue::capacity];
+    unsigned n;
+    while ((n = _commands.take(commands)) > 0) {
+        for (unsigned i = 0; i < n; i++) {
+            const uint16_t value = commands[i].value;
+            switch (commands[i].type) {
+            case CMD_GYRO_SCALE:
+                setGyroScale(value);
+                break;
+            case CMD_ACCEL_SCALE:
+                setAccelScale(value);
+                break;
+            case CMD_MAG_SCALE:
+                setMagScale(value);
+                break;
+            case CMD_GYRO_ODR:
+            case CMD_ACCEL_ODR:
+                if (_streamRate) {
+                    // Both run at the streaming rate, drainFIFO() flags it
+                    if ((value < 1) || (value > 6)) break;
+                    drainBeforeChange();
+                    setGyroODR(value);
+                    setAccelODR(value);
+                    _streamRate = value;
+                    _odrChanged = true;
+                    break;
+                }
+                if (commands[i].type == CMD_GYRO_ODR) setGyroODR(value);
+                else setAccelODR(value);
+                _commandFlags |= SAMPLE_ODR_CHANGE;
+                break;
+            case CMD_MAG_ODR:
+                setMagODR(value);
+                _commandFlags |= SAMPLE_ODR_CHANGE;
+                break;
+            }
+        }
+    }
+}
+
+void LSM9DS1::deliver(const LSM9DS1sample& sample)
+{
+    LSM9DS1_TRACE_SCOPE("deliver");
+    LSM9DS1_TIME_SCOPE(_callbackNs);
+    dispatch(sample);
+    if (_mSamples) _mSamples->inc();
+}
+
+void LSM9DS1::queue(const LSM9DS1sample& sample)
+{
+    if (_nPending == maxPending) {
+        _gap = true;
+        return;
+    }
+    _pending[_nPending++] = sample;
+    _lastTimestamp = sample.timestamp;
+}
+
+void LSM9DS1::queueBlockEnd()
+{
+    if (_nPending) _pendingBlockEnds |= (uint64_t)1 << (_nPending - 1);
+}
+
+void LSM9DS1::deliverPending()
+{
+    // Taken first in case a callback throws
+    const unsigned n = _nPending;
+    const uint64_t blockEnds = _pendingBlockEnds;
+    _nPending = 0;
+    _pendingBlockEnds = 0;
+    for (unsigned i = 0; i < n; i++) {
+        deliver(_pending[i]);
+        if ((blockEnds & ((uint64_t)1 << i)) && sampleSink) {
+            LSM9DS1_TIME_SCOPE(_callbackNs);
+            sampleSink->blockEnd();
+        }
+    }
+}
+
+void LSM9DS1::setMetrics(LSM9DS1metrics& metrics, const char* device)
+{
+    const std::string labels = std::string("device=\"") + device + "\"";
+    const char* l = labels.c_str();
+    _mSamples = &metrics.counter("lsm9ds1_samples_total",
+                                 "Samples delivered.", l);
+    _mBusErrors = &metrics.counter("lsm9ds1_bus_errors_total",
+                                   "Timer events skipped because of a failed bus read.", l);
+    _mRecoveries = &metrics.counter("lsm9ds1_recoveries_total",
+                                    "Successful timer events after bus errors.", l);
+    _mMissedTicks = &metrics.counter("lsm9ds1_missed_ticks_total",
+                                     "Timer events which didn't happen because the previous one was running.", l);
+    _mFIFOOverruns = &metrics.counter("lsm9ds1_fifo_overruns_total",
+                                      "FIFO drains which found the FIFO overrun.", l);
+#ifdef LSM9DS1_LATENCY
+    _mBusTime = &metrics.counter("lsm9ds1_bus_seconds_total",
+                                 "Time spent on the bus.", l, 1e-9);
+#endif
+}
+
+void LSM9DS1::fillSample(LSM9DS1sample& sample, uint64_t timestamp)
+{
+    sample.timestamp = timestamp;
+    sample.g[0] = gx; sample.g[1] = gy; sample.g[2] = gz;
+    sample.a[0] = ax; sample.a[1] = ay; sample.a[2] = az;
+    sample.m[0] = mx; sample.m[1] = my; sample.m[2] = mz;
+    sample.flags = _commandFlags;
+    _commandFlags = 0;
+    if (_gap) {
+        sample.flags |= SAMPLE_GAP;
+        _gap = false;
+    }
+    sample.scale = scaleCode(settings.gyro.scale, settings.accel.scale, settings.mag.scale);
+    if (sample.scale != _sampleScale) {
+        if (_sampleScale != 0xff) sample.flags |= SAMPLE_SCALE_CHANGE;
+        _sampleScale = sample.scale;
+    }
 }
 
 void LSM9DS1::end() {
@@ -519,16 +760,20 @@ uint8_t LSM9DS1::magAvailable(lsm9ds1_axis axis)
 
 void LSM9DS1::readAccel()
 {
-    uint8_t temp[6] = {0,0,0,0,0,0}; // We'll read six bytes from the accelerometer into temp
     try {
-        xgReadBytes(OUT_X_L_XL, temp, 6); // Read 6 bytes, beginning at OUT_X_L_XL
-        ax = (temp[1] << 8) | temp[0]; // Store x-axis values into ax
-        ay = (temp[3] << 8) | temp[2]; // Store y-axis values into ay
-        az = (temp[5] << 8) | temp[4]; // Store z-axis values into az
+        readAccelRaw();
     } catch(int fError) {
         ax = ay = az = 999;
-        return;
     }
+}
+
+void LSM9DS1::readAccelRaw()
+{
+    uint8_t temp[6] = {0,0,0,0,0,0}; // We'll read six bytes from the accelerometer into temp
+    xgReadBytes(OUT_X_L_XL, temp, 6); // Read 6 bytes, beginning at OUT_X_L_XL
+    ax = (temp[1] << 8) | temp[0]; // Store x-axis values into ax
+    ay = (temp[3] << 8) | temp[2]; // Store y-axis values into ay
+    az = (temp[5] << 8) | temp[4]; // Store z-axis values into az
 
     if (_autoCalc)
     {
@@ -576,22 +821,55 @@ void LSM9DS1::readTemp()
 
 void LSM9DS1::readGyro()
 {
-    uint8_t temp[6] = {0,0,0,0,0,0}; // We'll read six bytes from the gyro into temp
     try {
-        xgReadBytes(OUT_X_L_G, temp, 6); // Read 6 bytes, beginning at OUT_X_L_G
-        gx = (temp[1] << 8) | temp[0]; // Store x-axis values into gx
-        gy = (temp[3] << 8) | temp[2]; // Store y-axis values into gy
-        gz = (temp[5] << 8) | temp[4]; // Store z-axis values into gz
+        readGyroRaw();
     } catch(int fError) {
         gx = gy = gz = 9999;
-        return;
     }
+}
+
+void LSM9DS1::readGyroRaw()
+{
+    uint8_t temp[6] = {0,0,0,0,0,0}; // We'll read six bytes from the gyro into temp
+    xgReadBytes(OUT_X_L_G, temp, 6); // Read 6 bytes, beginning at OUT_X_L_G
+    gx = (temp[1] << 8) | temp[0]; // Store x-axis values into gx
+    gy = (temp[3] << 8) | temp[2]; // Store y-axis values into gy
+    gz = (temp[5] << 8) | temp[4]; // Store z-axis values into gz
+    if (_autoCalc)
+    {
+        gx -= gBiasRaw[X_AXIS];
+        gy -= gBiasRaw[Y_AXIS];
+        gz -= gBiasRaw[Z_AXIS];
+    }
+}
+
+uint8_t LSM9DS1::readGyroAccelRaw()
+{
+    // OUT_X_L_G to OUT_Z_H_XL in one auto-increment read. The control and
+    // status registers in between come along.
+    uint8_t temp[OUT_Z_H_XL - OUT_X_L_G + 1] = {0};
+    xgReadBytes(OUT_X_L_G, temp, sizeof(temp));
+    gx = (temp[1] << 8) | temp[0];
+    gy = (temp[3] << 8) | temp[2];
+    gz = (temp[5] << 8) | temp[4];
+    const uint8_t* a = temp + (OUT_X_L_XL - OUT_X_L_G);
+    ax = (a[1] << 8) | a[0];
+    ay = (a[3] << 8) | a[2];
+    az = (a[5] << 8) | a[4];
+    // Reading INT_GEN_SRC_XL acknowledges a latched interrupt: keep it
+    // for getAccelIntSrc() and the burst triggers
+    const uint8_t intSrc = temp[INT_GEN_SRC_XL - OUT_X_L_G];
+    if (intSrc & (1<<6)) _accelIntSrc |= intSrc;
     if (_autoCalc)
     {
         gx -= gBiasRaw[X_AXIS];
         gy -= gBiasRaw[Y_AXIS];
         gz -= gBiasRaw[Z_AXIS];
+        ax -= aBiasRaw[X_AXIS];
+        ay -= aBiasRaw[Y_AXIS];
+        az -= aBiasRaw[Z_AXIS];
     }
+    return intSrc;
 }
 
 int16_t LSM9DS1::readGyro(lsm9ds1_axis axis)
@@ -633,23 +911,30 @@ void LSM9DS1::setGyroScale(uint16_t gScl)
     uint8_t ctrl1RegValue = xgReadByte(CTRL_REG1_G);
     // Mask out scale bits (3 & 4):
     ctrl1RegValue &= 0xE7;
+    uint16_t scale;
     switch (gScl)
     {
         case 500:
             ctrl1RegValue |= (0x1 << 3);
-            settings.gyro.scale = 500;
+            scale = 500;
             break;
         case 2000:
             ctrl1RegValue |= (0x3 << 3);
-            settings.gyro.scale = 2000;
+            scale = 2000;
             break;
         default: // Otherwise we'll set it to 245 dps (0x0 << 4)
-            settings.gyro.scale = 245;
+            scale = 245;
             break;
     }
+    // FIFO entries so far were taken at the old scale, right before the
+    // write so that none come in between
+    drainBeforeChange();
     xgWriteByte(CTRL_REG1_G, ctrl1RegValue);
+    settings.gyro.scale = scale;
 
     calcgRes();
+    // Keep the bias in dps
+    for (int i = 0; i < 3; i++) gBiasRaw[i] = (int16_t)lrintf(gBias[i] / gRes);
 }
 
 void LSM9DS1::setAccelScale(uint8_t aScl)
@@ -658,29 +943,34 @@ void LSM9DS1::setAccelScale(uint8_t aScl)
     uint8_t tempRegValue = xgReadByte(CTRL_REG6_XL);
     // Mask out accel scale bits:
     tempRegValue &= 0xE7;
+    uint8_t scale;
 
     switch (aScl)
     {
         case 4:
             tempRegValue |= (0x2 << 3);
-            settings.accel.scale = 4;
+            scale = 4;
             break;
         case 8:
             tempRegValue |= (0x3 << 3);
-            settings.accel.scale = 8;
+            scale = 8;
             break;
         case 16:
             tempRegValue |= (0x1 << 3);
-            settings.accel.scale = 16;
+            scale = 16;
             break;
         default: // Otherwise it'll be set to 2g (0x0 << 3)
-            settings.accel.scale = 2;
+            scale = 2;
             break;
     }
+    drainBeforeChange();
     xgWriteByte(CTRL_REG6_XL, tempRegValue);
+    settings.accel.scale = scale;
 
     // Then calculate a new aRes, which relies on aScale being set correctly:
     calcaRes();
+    // Keep the bias in g
+    for (int i = 0; i < 3; i++) aBiasRaw[i] = (int16_t)lrintf(aBias[i] / aRes);
 }
 
 void LSM9DS1::setMagScale(uint8_t mScl)
@@ -768,33 +1058,17 @@ void LSM9DS1::setMagODR(uint8_t mRate)
 
 void LSM9DS1::calcgRes()
 {
-    gRes = ((float) settings.gyro.scale) / 32768.0;
+    gRes = gyroResolution(settings.gyro.scale);
 }
 
 void LSM9DS1::calcaRes()
 {
-    aRes = ((float) settings.accel.scale) / 32768.0;
+    aRes = accelResolution(settings.accel.scale);
 }
 
 void LSM9DS1::calcmRes()
 {
-    //mRes = ((float) settings.mag.scale) / 32768.0;
-    switch (settings.mag.scale)
-    {
-    case 4:
-        mRes = magSensitivity[0];
-        break;
-    case 8:
-        mRes = magSensitivity[1];
-        break;
-    case 12:
-        mRes = magSensitivity[2];
-        break;
-    case 16:
-        mRes = magSensitivity[3];
-        break;
-    }
-
+    mRes = magResolution(settings.mag.scale);
 }
 
 void LSM9DS1::configInt(interrupt_select interrupt, uint8_t generator,
@@ -860,7 +1134,8 @@ void LSM9DS1::configAccelThs(uint8_t threshold, lsm9ds1_axis axis, uint8_t durat
 
 uint8_t LSM9DS1::getAccelIntSrc()
 {
-    uint8_t intSrc = xgReadByte(INT_GEN_SRC_XL);
+    // Plus what FIFO drains have acknowledged in the meantime
+    uint8_t intSrc = xgReadByte(INT_GEN_SRC_XL) | _accelIntSrc.exchange(0);
 
     // Check if the IA_XL (interrupt active) bit is set
     if (intSrc & (1<<6))
@@ -972,6 +1247,285 @@ uint8_t LSM9DS1::getFIFOSamples()
     return (xgReadByte(FIFO_SRC) & 0x3F);
 }
 
+uint8_t LSM9DS1::readFIFOLevel()
+{
+    // FIFO_SRC: [FTH][OVRN][FSS5:0]
+    const uint8_t src = xgReadByte(FIFO_SRC);
+    if (src & (1<<6)) {
+        _fifoOverruns++;
+        if (_mFIFOOverruns) _mFIFOOverruns->inc();
+        _gap = true;
+    }
+    return src & 0x3F;
+}
+
+void LSM9DS1::enableDutyCycling(uint8_t duration, uint8_t threshold, long idlePeriod)
+{
+    _idlePeriod = idlePeriod;
+    // The gyro sleeps (instead of powering down) on inactivity
+    configInactivity(duration, threshold, true);
+    _dutyCycling = true;
+}
+
+void LSM9DS1::disableDutyCycling()
+{
+    if (!_dutyCycling) return;
+    _dutyCycling = false;
+    configInactivity(0, 0, false);
+    sleepGyro(false);
+    if (_stationary) {
+        _stationary = false;
+        _activityChanged = true;
+        start(_timerPeriod);
+    }
+}
+
+// Full scales in the order auto-ranging steps through them
+static const uint16_t gyroScales[3] = {245, 500, 2000};
+static const uint16_t accelScales[4] = {2, 4, 8, 16};
+
+// One step of the auto-ranging of a sensor.
+// Returns the new scale or 0 to stay.
+static uint16_t rangeStep(const uint16_t* scales, int nScales, uint16_t scale,
+                          const int16_t* v, int32_t& peak, uint64_t& windowStart,
+                          uint64_t now, uint64_t windowNs)
+{
+    int i = 0;
+    while ((i < nScales - 1) && (scales[i] != scale)) i++;
+    int32_t p = 0;
+    for (int j = 0; j < 3; j++) {
+        const int32_t a = v[j] < 0 ? -(int32_t)v[j] : v[j];
+        if (a > p) p = a;
+    }
+    if ((p >= 31784) && (i < nScales - 1)) {
+        // Clipping or about to
+        peak = 0;
+        windowStart = now;
+        return scales[i + 1];
+    }
+    if (p > peak) peak = p;
+    if (now - windowStart < windowNs) return 0;
+    const int32_t windowPeak = peak;
+    peak = 0;
+    windowStart = now;
+    // Would the window have stayed below half of the lower range?
+    if ((i > 0) && (windowPeak * scales[i] < 16384 * (int32_t)scales[i - 1]))
+        return scales[i - 1];
+    return 0;
+}
+
+void LSM9DS1::enableAutoRange(bool accel, bool gyro, double windowSeconds)
+{
+    _rangeWindowNs = (uint64_t)(windowSeconds * 1e9);
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    const uint64_t now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    _accelPeak = _gyroPeak = 0;
+    _accelWindowStart = _gyroWindowStart = now;
+    _autoRangeAccel = accel;
+    _autoRangeGyro = gyro;
+}
+
+void LSM9DS1::disableAutoRange()
+{
+    _autoRangeAccel = false;
+    _autoRangeGyro = false;
+}
+
+bool LSM9DS1::autoRange(const LSM9DS1sample& sample, uint64_t now)
+{
+    bool switched = false;
+    if (_autoRangeGyro) {
+        const uint16_t s = rangeStep(gyroScales, 3, settings.gyro.scale, sample.g,
+                                     _gyroPeak, _gyroWindowStart, now, _rangeWindowNs);
+        if (s) {
+            setGyroScale(s);
+            switched = true;
+        }
+    }
+    if (_autoRangeAccel) {
+        const uint16_t s = rangeStep(accelScales, 4, settings.accel.scale, sample.a,
+                                     _accelPeak, _accelWindowStart, now, _rangeWindowNs);
+        if (s) {
+            setAccelScale((uint8_t)s);
+            switched = true;
+        }
+    }
+    return switched;
+}
+
+void LSM9DS1::drainBeforeChange()
+{
+    if ((!_streamRate) && (!_burstTriggers)) return;
+    uint64_t period;
+    if (_streamRate) period = odrPeriod(_streamRate);
+    else period = odrPeriod(_bursting ? (uint8_t)G_ODR_952 : _idleRate);
+    // Until it's empty: entries keep coming in while it's drained
+    uint8_t n;
+    unsigned drained = 0;
+    while ((n = readFIFOLevel()) > 0) {
+        if (drained >= 2 * 32) {
+            // The bus doesn't keep up with the ODR: rather drop the rest
+            // (bypass mode empties the FIFO) than give it the new settings
+            setFIFO(FIFO_OFF, 0x00);
+            setFIFO(FIFO_CONT, 0x1F);
+            _gap = true;
+            break;
+        }
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        const uint64_t now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+        drainFIFO(n, now, period, _odrChanged ? 0 : n);
+        drained += n;
+    }
+}
+
+void LSM9DS1::enableBurstCapture(uint8_t triggers, uint8_t idleRate,
+                                 double burstSeconds, uint8_t preEventSamples)
+{
+    if (!_burstTriggers) {
+        _savedGyroRate = settings.gyro.sampleRate;
+        _savedAccelRate = settings.accel.sampleRate;
+    }
+    _idleRate = ((idleRate >= 1) && (idleRate <= 5)) ? idleRate : (uint8_t)G_ODR_149;
+    _preEventSamples = preEventSamples <= 0x1F ? preEventSamples : 0x1F;
+    _burstNs = (uint64_t)(burstSeconds * 1e9);
+    _bursting = false;
+    _idleEntries = 0;
+    _odrChanged = true;
+    setGyroODR(_idleRate);
+    setAccelODR(_idleRate);
+    enableFIFO(true);
+    setFIFO(FIFO_CONT, 0x1F);
+    // Last, as timerEvent() looks at it
+    _burstTriggers = triggers;
+}
+
+void LSM9DS1::disableBurstCapture()
+{
+    if (!_burstTriggers) return;
+    _burstTriggers = 0;
+    enableFIFO(false);
+    setFIFO(FIFO_OFF, 0x00);
+    setGyroODR(_savedGyroRate);
+    setAccelODR(_savedAccelRate);
+    _bursting = false;
+}
+
+void LSM9DS1::enableFIFOStreaming(uint8_t rate)
+{
+    if (!_streamRate) {
+        _savedGyroRate = settings.gyro.sampleRate;
+        _savedAccelRate = settings.accel.sampleRate;
+    }
+    if ((rate < 1) || (rate > 6)) rate = G_ODR_952;
+    _odrChanged = true;
+    setGyroODR(rate);
+    setAccelODR(rate);
+    enableFIFO(true);
+    setFIFO(FIFO_CONT, 0x1F);
+    // Last, as timerEvent() looks at it
+    _streamRate = rate;
+}
+
+void LSM9DS1::disableFIFOStreaming()
+{
+    if (!_streamRate) return;
+    _streamRate = 0;
+    enableFIFO(false);
+    setFIFO(FIFO_OFF, 0x00);
+    setGyroODR(_savedGyroRate);
+    setAccelODR(_savedAccelRate);
+    _odrChanged = false;
+}
+
+void LSM9DS1::burstCaptureEvent(uint64_t now)
+{
+    // STATUS_REG_1: [0][IG_XL][IG_G][INACT][BOOT_STATUS][TDA][GDA][XLDA]
+    const uint8_t status = xgReadByte(STATUS_REG_1);
+    bool event = false;
+    // The last drain may have acknowledged it already
+    if ((_burstTriggers & BURST_ON_ACCEL_INT) && ((status & (1<<6)) || (_accelIntSrc & (1<<6)))) {
+        getAccelIntSrc(); // acknowledges a latched interrupt
+        event = true;
+    }
+    if ((_burstTriggers & BURST_ON_GYRO_INT) && (status & (1<<5))) {
+        getGyroIntSrc();
+        event = true;
+    }
+    if ((_burstTriggers & BURST_ON_ACTIVITY) && !(status & (1<<4))) event = true;
+    if (event) _burstUntil = now + _burstNs;
+
+    readMag();
+    const uint64_t idlePeriod = odrPeriod(_idleRate);
+    const uint64_t burstPeriod = odrPeriod(G_ODR_952);
+
+    if ((!_bursting) && event) {
+        // Switch up. Changing the ODR leaves the FIFO alone so the idle
+        // history before the event is still there.
+        _idleEntries = getFIFOSamples();
+        _switchTime = now;
+        setGyroODR(G_ODR_952);
+        setAccelODR(XL_ODR_952);
+        _bursting = true;
+        _odrChanged = true;
+    }
+
+    if (!_bursting) {
+        // Idle: keep the newest entries as pre-event history
+        const uint8_t n = readFIFOLevel();
+        if (n > _preEventSamples)
+            drainFIFO(n - _preEventSamples, now - _preEventSamples * idlePeriod,
+                      idlePeriod, _odrChanged ? 0 : n);
+        return;
+    }
+
+    // Switch down before reading the fill level so that all entries
+    // drained now were sampled at the burst rate.
+    const bool switchDown = now >= _burstUntil;
+    if (switchDown) {
+        setGyroODR(_idleRate);
+        setAccelODR(_idleRate);
+    }
+    const uint8_t n = readFIFOLevel();
+    // The idle history first, timed backwards from the switch
+    const uint8_t old = (_idleEntries < n) ? _idleEntries : n;
+    if (old) {
+        drainFIFO(old, _switchTime - (uint64_t)(_idleEntries - old) * idlePeriod,
+                  idlePeriod, old);
+        _idleEntries -= old;
+    }
+    drainFIFO(n - old, now, burstPeriod, _odrChanged ? 0 : n);
+    if (switchDown) {
+        _bursting = false;
+        _odrChanged = true;
+    }
+}
+
+void LSM9DS1::drainFIFO(uint8_t n, uint64_t newest, uint64_t period, uint8_t odrChangeAt)
+{
+    if (n == 0) return;
+    LSM9DS1sample sample;
+    for (uint8_t i = 0; i < n; i++) {
+        // Reading the output registers pops the FIFO
+        const uint8_t intSrc = readGyroAccelRaw();
+        // Estimated times, for example of the idle history of a burst,
+        // must not go back before what has been queued already
+        uint64_t t = newest - (uint64_t)(n - 1 - i) * period;
+        if (t < _lastTimestamp) t = _lastTimestamp;
+        fillSample(sample, t);
+        if (_pollAccelInt && (intSrc & (1<<6))) sample.flags |= SAMPLE_ACCEL_INT;
+        if (i == odrChangeAt) {
+            sample.flags |= SAMPLE_ODR_CHANGE;
+            _odrChanged = false;
+        }
+        // A drain before a change can be longer than the pending queue
+        if (_nPending == maxPending) deliverPending();
+        queue(sample);
+    }
+    queueBlockEnd();
+}
+
 void LSM9DS1::constrainScales()
 {
     if ((settings.gyro.scale != 245) && (settings.gyro.scale != 500) &&
@@ -1094,51 +1648,21 @@ void LSM9DS1::initI2C()
 {
 }
 
-// Wire.h read and write protocols
 void LSM9DS1::I2CwriteByte(uint8_t address, uint8_t subAddress, uint8_t data)
 {
-    _fd = wiringPiI2CSetup(address);
-    if (_fd < 0) {
-        fprintf(stderr, "Error: I2CSetup failed\n");
-        exit(EXIT_FAILURE);
-    }
-    wiringPiI2CWriteReg8(_fd, subAddress, data);
-    close(_fd);
+    LSM9DS1_TIME_SCOPE(_busNs);
+    _transport->writeByte(address, subAddress, data);
 }
 
 uint8_t LSM9DS1::I2CreadByte(uint8_t address, uint8_t subAddress)
 {
-    _fd = wiringPiI2CSetup(address);
-    if (_fd < 0) {
-        fprintf(stderr, "Error: I2CSetup failed\n");
-        exit(EXIT_FAILURE);
-    }
-    uint8_t data; // `data` will store the register data
-    wiringPiI2CWrite(_fd, subAddress);
-    data = wiringPiI2CRead(_fd);                // Fill Rx buffer with result
-    close(_fd);
-    return data;                             // Return data read from slave register
+    LSM9DS1_TIME_SCOPE(_busNs);
+    return _transport->readByte(address, subAddress);
 }
 
 uint8_t LSM9DS1::I2CreadBytes(uint8_t address, uint8_t subAddress, uint8_t * dest, uint8_t count)
 {
-    _fd = wiringPiI2CSetup(address);
-    if (_fd < 0) {
-        fprintf(stderr, "Error: I2C Setup\n");
-        exit(EXIT_FAILURE);
-    }
-    wiringPiI2CWrite(_fd, subAddress);
-    uint8_t temp_dest[count];
-    if ((read(_fd, temp_dest, 6)) < 0) {
-        //fprintf(stderr, "Error: read value\n");
-        throw 999;
-        return 0;
-    }
-    close(_fd);
-    for (int i = 0; i < count; i++) {
-        dest[i] = temp_dest[i];
-    }
-    return count;
+    LSM9DS1_TRACE_SCOPE("I2CreadBytes");
+    LSM9DS1_TIME_SCOPE(_busNs);
+    return _transport->readBytes(address, subAddress, dest, count);
 }
-
-
@@ -27,8 +27,14 @@ Distributed as-is; no warranty is given.
 #include <stdlib.h>
 #include <stdint.h>
 #include <thread>
+#include <atomic>
 #include "LSM9DS1_Registers.h"
 #include "LSM9DS1_Types.h"
+#include "LSM9DS1_Source.h"
+#include "LSM9DS1_Transport.h"
+#include "LSM9DS1_Latency.h"
+#include "LSM9DS1_Metrics.h"
+#include "LSM9DS1_Command.h"
 #include "CppTimer.h"
 
 #define LSM9DS1_AG_ADDR(sa0)    ((sa0) == 0 ? 0x6A : 0x6B)
@@ -41,23 +47,7 @@ enum lsm9ds1_axis {
 		   ALL_AXIS
 };
 
-class LSM9DS1callback {
-public:
-        /**
-         * Called after a sample has arrived.
-         **/
-        virtual void hasSample(float gx,
-			       float gy,
-			       float gz,
-			       float ax,
-			       float ay,
-			       float az,
-			       float mx,
-			       float my,
-			       float mz) = 0;
-};
-
-class LSM9DS1 : public CppTimer
+class LSM9DS1 : public CppTimer, public LSM9DS1source
 {
 public:
 	IMUSettings settings;
@@ -86,18 +76,30 @@ public:
 	//                If IMU_MODE_SPI, this is the cs pin of the magnetometer (CS_M)
 	LSM9DS1(interface_mode interface, uint8_t xgAddr, uint8_t mAddr);
 	LSM9DS1();
+
+	// LSM9DS1 -- Constructor for a device behind another transport than
+	// the I2C bus, for example LSM9DS1simulator. wiringPi isn't set up.
+	// Input:
+	//    - transport = register access, has to live as long as the device
+	//    - xgAddr, mAddr = I2C addresses as above
+	LSM9DS1(LSM9DS1transport& transport,
+		uint8_t xgAddr = LSM9DS1_AG_ADDR(1), uint8_t mAddr = LSM9DS1_M_ADDR(1));
         
 	// begin() -- Initialize the gyro, accelerometer, and magnetometer.
 	// This will set up the scale and output rate of each sensor. The values set
 	// in the IMUSettings struct will take effect after calling this function.
+	// Everything which allocates memory happens here and in the setters
+	// (setMetrics(), LSM9DS1tracer::registerThread(), constructing sinks
+	// and pipeline stages). After begin() the acquisition in timerEvent(),
+	// the pipeline stages, the buffered sink's producer side and the
+	// metrics and trace recording do not allocate, and bus reads go
+	// straight into the buffer they are decoded from.
 	uint16_t begin();
 
 	// ends a possible thread in the background
 	void end();
 
-	void setCallback(LSM9DS1callback* cb) {
-		lsm9ds1Callback = cb;
-	}
+	// setCallback() and setSampleSink() are in LSM9DS1source.
     
 	void calibrate(bool autoCalc = true);
 	void calibrateMag(bool loadIn = true);
@@ -238,6 +240,32 @@ public:
 	// Input:
 	//    - mRate = The desired output rate of the mag.
 	void setMagODR(uint8_t mRate);
+
+	// postCommand() -- The setters above for other threads while the timer
+	// runs: the next timer event applies the command after its read. A
+	// new scale is flagged SAMPLE_SCALE_CHANGE and converted with the
+	// new resolution from the first sample on which has it, a new ODR is
+	// flagged SAMPLE_ODR_CHANGE. While streaming the FIFO a gyro or accel
+	// ODR sets the streaming rate. With FIFO streaming or burst capture
+	// the entries still in the FIFO are drained before a gyro/accel scale
+	// or the streaming rate changes, so that only entries taken after the
+	// change get the new scale or rate (in burst capture this includes
+	// the pre-event history). Lock-free, never blocks.
+	// Input:
+	//    - type = which setter, see command_type
+	//    - value = its argument
+	// Output: false if the queue is full.
+	bool postCommand(command_type type, uint16_t value) {
+		const LSM9DS1command command = {type, value};
+		return _commands.post(&command, 1);
+	}
+
+	// postCommands() -- Several commands applied in the same timer event,
+	// for example a scale and an ODR which have to change together.
+	// Output: false if the queue has no room for all of them.
+	bool postCommands(const LSM9DS1command* commands, unsigned n) {
+		return _commands.post(commands, n);
+	}
     
 	// configInactivity() -- Configure inactivity interrupt parameters
 	// Input:
@@ -322,6 +350,9 @@ public:
 	uint8_t getGyroIntSrc();
     
 	// getGyroIntSrc() -- Get contents of accelerometer interrupt source register
+	// FIFO streaming and burst capture read (and so acknowledge) it with
+	// every FIFO entry; the sources they saw since the last call are
+	// returned as well.
 	uint8_t getAccelIntSrc();
     
 	// getGyroIntSrc() -- Get contents of magnetometer interrupt source register
@@ -329,6 +360,17 @@ public:
     
 	// getGyroIntSrc() -- Get status of inactivity interrupt
 	uint8_t getInactivity();
+
+	// pollAccelInt() -- Read the accel interrupt source with every sample
+	// and mark the samples during which the generator set up with
+	// configAccelInt() / configAccelThs() was active with SAMPLE_ACCEL_INT.
+	// Costs one extra register read per sample when polling. FIFO
+	// streaming and burst capture read it with every entry anyway.
+	// Input:
+	//    - enable: true = poll, false = don't poll.
+	void pollAccelInt(bool enable = true) {
+		_pollAccelInt = enable;
+	}
     
 	// sleepGyro() -- Sleep or wake the gyroscope
 	// Input:
@@ -350,24 +392,292 @@ public:
     
 	// getFIFOSamples() - Get number of FIFO samples
 	uint8_t getFIFOSamples();
+
+	// enableBurstCapture() - Idle at a low ODR and capture at 952 Hz through
+	// the FIFO for a while after an interrupt. The interrupt generators have
+	// to be set up first with configAccelInt() / configAccelThs(),
+	// configGyroInt() / configGyroThs() or configInactivity().
+	// While idle the newest preEventSamples stay in the FIFO and are
+	// delivered ahead of the burst; older idle samples are delivered with
+	// that delay. The gyro/accel ODR is switched without clearing the FIFO
+	// and the first sample at a new rate is flagged SAMPLE_ODR_CHANGE.
+	// The magnetometer isn't in the FIFO: all samples of one drain carry
+	// the same mag reading. The timer period must stay below the 33 ms
+	// it takes to fill the FIFO at 952 Hz.
+	// Input:
+	//    - triggers = Any OR'd combination of BURST_ON_ACCEL_INT,
+	//      BURST_ON_GYRO_INT, BURST_ON_ACTIVITY
+	//    - idleRate = gyro/accel ODR while idle, 1-5 (see gyro_odr)
+	//    - burstSeconds = capture time after the last event
+	//    - preEventSamples = FIFO history kept while idle, 0-31
+	void enableBurstCapture(uint8_t triggers, uint8_t idleRate = G_ODR_149,
+				double burstSeconds = 1.0, uint8_t preEventSamples = 16);
+
+	// disableBurstCapture() - Back to reading one sample per timer event
+	// at the ODR from the settings.
+	void disableBurstCapture();
+
+	// isBursting() - True while a burst is captured.
+	bool isBursting() const {
+		return _bursting;
+	}
+
+	// enableFIFOStreaming() - Run the gyro/accel at a fixed ODR and let
+	// timerEvent() drain the FIFO: every timer event delivers all samples
+	// acquired since the last one, each drain followed by blockEnd().
+	// Timestamps are spaced by the ODR backwards from the read. The
+	// magnetometer isn't in the FIFO: all samples of one drain carry the
+	// same mag reading. The timer period must stay below the time it takes
+	// to fill the 32 entries (33 ms at 952 Hz). Put an
+	// LSM9DS1oversampleStage behind it to trade the rate for resolution.
+	// Not to be combined with enableBurstCapture() or enableDutyCycling().
+	// Input:
+	//    - rate = gyro/accel ODR, 1-6 (see gyro_odr)
+	void enableFIFOStreaming(uint8_t rate = G_ODR_952);
+
+	// disableFIFOStreaming() - Back to reading one sample per timer event
+	// at the ODR from the settings.
+	void disableFIFOStreaming();
+
+	// getMissedTicks() - Number of timer events which didn't happen because
+	// the previous one was still running. When polling (no FIFO) each of
+	// them is a lost sample and the next sample is flagged SAMPLE_GAP.
+	unsigned long getMissedTicks() const {
+		return _missedTicks;
+	}
+
+	// getFIFOOverruns() - Number of FIFO drains which found the FIFO
+	// overrun (FIFO_SRC OVRN), i.e. samples were overwritten before they
+	// were read. The first sample of such a drain is flagged SAMPLE_GAP.
+	unsigned long getFIFOOverruns() const {
+		return _fifoOverruns;
+	}
+
+	// setMetrics() - Registers the counters of this device with a metrics
+	// registry and keeps them up to date: samples delivered, bus errors,
+	// recoveries after bus errors, missed timer events, FIFO overruns and,
+	// with -DLSM9DS1_LATENCY=ON, the time spent on the bus. A failed bus
+	// read ends the timer event: the samples read before it are delivered
+	// and the next sample is flagged SAMPLE_GAP. Exceptions thrown by
+	// callbacks and sinks aren't counted, they propagate.
+	// Call it before begin().
+	// Input:
+	//    - metrics = the registry, has to live as long as the device
+	//    - device = value of the "device" label of the metrics
+	void setMetrics(LSM9DS1metrics& metrics, const char* device = "lsm9ds1");
+
+	// getLatency() - Histograms of the wakeup latency, bus time and
+	// callback time of the timer events. They are only filled when the
+	// library is built with -DLSM9DS1_LATENCY=ON, see LSM9DS1_Latency.h.
+	LSM9DS1latency& getLatency() {
+		return latency;
+	}
+
+	// enableDutyCycling() - Let the gyro sleep and poll less often while
+	// the device is stationary. The inactivity generator puts the gyro to
+	// sleep by itself; timerEvent() checks its INACT status and switches
+	// the timer between the normal and the idle period. While stationary
+	// the gyro isn't read (its values are 0) and the samples are flagged
+	// SAMPLE_INACTIVE. The first sample after a change is flagged
+	// SAMPLE_ACTIVITY_CHANGE. Activity is noticed within one idle period.
+	// Not to be combined with enableBurstCapture().
+	// Input:
+	//    - duration = Inactivity duration, see configInactivity()
+	//    - threshold = Activity threshold, see configInactivity()
+	//    - idlePeriod = timer period in ns while stationary
+	void enableDutyCycling(uint8_t duration, uint8_t threshold,
+			       long idlePeriod = 200000000);
+
+	// disableDutyCycling() - Wakes the gyro and polls at the normal rate.
+	void disableDutyCycling();
+
+	// isStationary() - True while the duty cycling sees no activity.
+	bool isStationary() const {
+		return _stationary;
+	}
+
+	// enableAutoRange() - Let timerEvent() pick the full scale of the accel
+	// and/or the gyro. A sample within 3% of +/-32767 on any axis switches
+	// one scale up straight away. The scale goes one down once a whole
+	// window of samples stayed below half of the lower scale's range, so
+	// the two thresholds don't chase each other. Every sample carries the
+	// scales it was taken with and the first one at new scales is flagged
+	// SAMPLE_SCALE_CHANGE. When polling the switch assumes that the ODR is
+	// faster than the timer: the next reading is then taken at the new
+	// scale. With FIFO streaming every drained sample is checked and the
+	// entries still in the FIFO are drained before a switch, so that all
+	// of them carry the scale they were taken with. The biases of
+	// calibrate() are kept in physical units across a switch.
+	// Not applied during burst capture or while stationary.
+	// Input:
+	//    - accel = auto-range the accelerometer (2 to 16 g)
+	//    - gyro = auto-range the gyroscope (245 to 2000 dps)
+	//    - windowSeconds = time of low amplitude before switching down
+	void enableAutoRange(bool accel, bool gyro, double windowSeconds = 1.0);
+
+	// disableAutoRange() - Keeps the current scales.
+	void disableAutoRange();
         
 
 protected:
-	// File descriptors
-	int _fd;
+	// Register access, _i2c unless given to the constructor
+	LSM9DS1i2cTransport _i2c;
+	LSM9DS1transport* _transport = &_i2c;
     
 	// x_mAddress and gAddress store the I2C address or SPI chip select pin
 	// for each sensor.
 	uint8_t _mAddress, _xgAddress;
     
-	// gRes, aRes, and mRes store the current resolution for each sensor. 
-	// Units of these values would be DPS (or g's or Gs's) per ADC tick.
-	// This value is calculated as (sensor scale) / (2^15).
-	float gRes, aRes, mRes;
-    
 	// _autoCalc keeps track of whether we're automatically subtracting off
 	// accelerometer and gyroscope bias calculated in calibrate().
 	bool _autoCalc;
+
+	// _pollAccelInt keeps track of whether timerEvent() reads the accel
+	// interrupt source, see pollAccelInt().
+	bool _pollAccelInt = false;
+
+	// State of the burst capture, see enableBurstCapture().
+	// _burstTriggers is 0 if it's disabled.
+	uint8_t _burstTriggers = 0;
+	uint8_t _idleRate = 0;
+	uint8_t _savedGyroRate = 0, _savedAccelRate = 0;
+	uint8_t _preEventSamples = 0;
+	uint64_t _burstNs = 0;
+	uint64_t _burstUntil = 0;
+	bool _bursting = false;
+	// INT_GEN_SRC_XL with IA_XL set as FIFO drains read it, for
+	// getAccelIntSrc() and the burst trigger
+	std::atomic<uint8_t> _accelIntSrc{0};
+	// Entries sampled at the idle rate still in the FIFO after switching
+	// up, and when it happened.
+	uint8_t _idleEntries = 0;
+	uint64_t _switchTime = 0;
+	// The next sample delivered is the first one at a new rate
+	bool _odrChanged = false;
+
+	// ODR of the FIFO streaming, 0 if it's disabled.
+	// See enableFIFOStreaming().
+	uint8_t _streamRate = 0;
+
+	// burstCaptureEvent() -- timerEvent() in burst capture mode.
+	void burstCaptureEvent(uint64_t now);
+
+	// drainFIFO() -- Reads the n oldest FIFO entries into the pending
+	// samples, followed by a blockEnd(). Delivers the pending samples
+	// first when there's no room for more. The timestamps are never
+	// before the one of the last sample queued.
+	// Input:
+	//    - n = number of entries
+	//    - newest = timestamp of the newest of them
+	//    - period = sampling interval in ns
+	//    - odrChangeAt = index of the first entry at a new rate or n for none
+	void drainFIFO(uint8_t n, uint64_t newest, uint64_t period, uint8_t odrChangeAt);
+
+	// Period of the timer in ns and state of the duty cycling,
+	// see enableDutyCycling().
+	long _timerPeriod = 20*1000*1000;
+	long _idlePeriod = 0;
+	bool _dutyCycling = false;
+	bool _stationary = false;
+	bool _activityChanged = false;
+
+	// State of the auto-ranging, see enableAutoRange(). Peak magnitude
+	// seen in the current window and when the window started.
+	bool _autoRangeAccel = false, _autoRangeGyro = false;
+	uint64_t _rangeWindowNs = 0;
+	int32_t _accelPeak = 0, _gyroPeak = 0;
+	uint64_t _accelWindowStart = 0, _gyroWindowStart = 0;
+	// Scale code of the last sample, 0xff before the first one
+	uint8_t _sampleScale = 0xff;
+
+	// autoRange() -- Checks a sample against the thresholds and switches
+	// the scales for the next one.
+	// Output: true if a scale was switched.
+	bool autoRange(const LSM9DS1sample& sample, uint64_t now);
+
+	// drainBeforeChange() -- With FIFO streaming or burst capture: drains
+	// the FIFO until it's empty so that every entry taken at the current
+	// scale and rate is in the pending samples or delivered. If it isn't
+	// empty after two FIFOs' worth the rest is dropped and the next
+	// sample flagged SAMPLE_GAP.
+	// setGyroScale() and setAccelScale() call it right before their
+	// write; call it before changing the ODR.
+	void drainBeforeChange();
+
+	// Overrun counters, see getMissedTicks() and getFIFOOverruns().
+	// _gap flags the next sample SAMPLE_GAP.
+	std::atomic<unsigned long> _missedTicks{0};
+	std::atomic<unsigned long> _fifoOverruns{0};
+	bool _gap = false;
+
+	// readFIFOLevel() -- Number of entries in the FIFO. Counts overruns.
+	uint8_t readFIFOLevel();
+
+	// Metrics updated by the acquisition, NULL without setMetrics().
+	LSM9DS1metric* _mSamples = NULL;
+	LSM9DS1metric* _mBusErrors = NULL;
+	LSM9DS1metric* _mRecoveries = NULL;
+	LSM9DS1metric* _mMissedTicks = NULL;
+	LSM9DS1metric* _mFIFOOverruns = NULL;
+	LSM9DS1metric* _mBusTime = NULL;
+	// The last timer event failed on the bus
+	bool _busFailed = false;
+
+	// Commands from other threads and the flags for the next sample
+	LSM9DS1commandQueue _commands;
+	uint16_t _commandFlags = 0;
+
+	// applyCommands() -- Applies the queued commands, in timerEvent().
+	void applyCommands();
+
+	// acquire() -- Reads the sensor at a timer event into the pending
+	// sample(s) according to the mode. A failed bus read throws the int
+	// from the transport.
+	void acquire(uint64_t now);
+
+	// readGyroRaw(), readAccelRaw() -- readGyro() and readAccel() for
+	// acquire(): a failed bus read throws instead of returning 9999/999.
+	void readGyroRaw();
+	void readAccelRaw();
+
+	// readGyroAccelRaw() -- Both in one bus transaction, which pops one
+	// FIFO entry. Throws like readGyroRaw().
+	// Output: INT_GEN_SRC_XL, which the transaction reads and so
+	// acknowledges. Also kept in _accelIntSrc if IA_XL is set.
+	uint8_t readGyroAccelRaw();
+
+	// deliver() -- Hands a sample to the sink and the callback.
+	void deliver(const LSM9DS1sample& sample);
+
+	// Samples read in this timer event, delivered after the bus transfers
+	// so that exceptions of callbacks and sinks aren't taken for bus
+	// errors. Bit i of _pendingBlockEnds: blockEnd() after sample i.
+	// A FIFO drain is at most 32 entries, only drainBeforeChange() can
+	// fill it up and deliver early.
+	static const unsigned maxPending = 64;
+	LSM9DS1sample _pending[maxPending];
+	unsigned _nPending = 0;
+	uint64_t _pendingBlockEnds = 0;
+	// Timestamp of the last sample queued
+	uint64_t _lastTimestamp = 0;
+
+	// queue() -- Adds a sample to the pending ones.
+	void queue(const LSM9DS1sample& sample);
+
+	// queueBlockEnd() -- blockEnd() after the last pending sample.
+	void queueBlockEnd();
+
+	// deliverPending() -- Delivers the pending samples, in timerEvent()
+	// or when drainFIFO() runs out of room.
+	void deliverPending();
+
+	// Latency histograms and the bus and callback time of the
+	// current timer event, see getLatency().
+	LSM9DS1latency latency;
+	uint64_t _busNs = 0, _callbackNs = 0;
+
+	// fillSample() -- Copies the current readings into a sample.
+	void fillSample(LSM9DS1sample& sample, uint64_t timestamp);
     
 	// init() -- Sets up gyro, accel, and mag settings to default.
 	// - interface - Sets the interface mode (IMU_MODE_I2C or IMU_MODE_SPI)
@@ -545,7 +855,6 @@ protected:
 	//         all stored in the *dest array given.
 	uint8_t I2CreadBytes(uint8_t address, uint8_t subAddress, uint8_t * dest, uint8_t count);
 
-	LSM9DS1callback* lsm9ds1Callback = NULL;
 	void timerEvent();
 };
 
@@ -0,0 +1,101 @@
+/******************************************************************************
+LSM9DS1_Async.cpp
+Event loop wake-up and batches of the coroutine interface.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "LSM9DS1_Async.h"
+
+LSM9DS1asyncSink::LSM9DS1asyncSink(unsigned capacity, buffer_policy policy)
+    : LSM9DS1bufferedSink(NULL, capacity, policy, false), armed(false), finished(false)
+{
+    batch = new LSM9DS1sample[this->capacity];
+    for (uint64_t i = 0; i < this->capacity; i++) batch[i] = LSM9DS1sample();
+    fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        delete[] batch;
+        throw "Could not create eventfd.";
+    }
+}
+
+LSM9DS1asyncSink::~LSM9DS1asyncSink()
+{
+    close(fd);
+    delete[] batch;
+}
+
+// Runs in the acquisition context after a sample has been queued:
+// only async-signal-safe calls.
+void LSM9DS1asyncSink::wake()
+{
+    if (armed.exchange(false)) {
+        const uint64_t one = 1;
+        if (write(fd, &one, sizeof(one))) {}
+    }
+}
+
+bool LSM9DS1asyncSink::suspend(void* handle, void (*resumeFunction)(void*))
+{
+    waiting = handle;
+    resume = resumeFunction;
+    armed = true;
+    // A sample may have come in before the producer saw armed. Both
+    // sides store, then load, so both need sequential consistency.
+    if (head.load() == tail.load()) return true;
+    if (armed.exchange(false)) {
+        waiting = nullptr;
+        return false;
+    }
+    // Too late: the producer has taken armed and wakes the loop
+    return true;
+}
+
+void LSM9DS1asyncSink::dispatch()
+{
+    uint64_t count;
+    if (read(fd, &count, sizeof(count))) {}
+    if (!waiting || (available() == 0)) return;
+    void* handle = waiting;
+    waiting = nullptr;
+    resume(handle);
+}
+
+LSM9DS1sampleBatch LSM9DS1asyncSink::take(unsigned max)
+{
+    if ((!max) || (max > capacity)) max = (unsigned)capacity;
+    unsigned n = 0;
+    Entry e;
+    while ((n < max) && takeEntry(e))
+        if (!e.blockEnd) batch[n++] = e.sample;
+    LSM9DS1sampleBatch b = {batch, n};
+    return b;
+}
+
+const LSM9DS1sample* LSM9DS1asyncSink::pull()
+{
+    for (;;) {
+        const LSM9DS1sampleBatch b = take(1);
+        if (b.n) return b.samples;
+        if (!blocking || finished) return NULL;
+        // As suspend(), but the thread sleeps in poll()
+        armed = true;
+        if ((head.load() == tail.load()) && !finished) {
+            struct pollfd p = {fd, POLLIN, 0};
+            poll(&p, 1, -1);
+        }
+        armed = false;
+        uint64_t count;
+        if (read(fd, &count, sizeof(count))) {}
+    }
+}
+
+void LSM9DS1asyncSink::finish()
+{
+    finished = true;
+    const uint64_t one = 1;
+    if (write(fd, &one, sizeof(one))) {}
+}
@@ -0,0 +1,163 @@
+/******************************************************************************
+LSM9DS1_Async.h
+Coroutine interface to the sample stream.
+
+LSM9DS1asyncSink is an LSM9DS1bufferedSink whose ring is consumed by a
+coroutine instead of the consumer thread:
+
+    LSM9DS1asyncSink samples;
+    imu.setSampleSink(&samples);
+    ...
+    for (;;) {
+        LSM9DS1sampleBatch batch = co_await samples.nextBatch();
+        for (const LSM9DS1sample& s : batch) ...
+    }
+
+The timer event can't resume a coroutine from its signal handler.
+Instead, when a coroutine waits, it makes the eventfd getFd() readable.
+The application's event loop (epoll, poll, an asio descriptor, ...)
+watches that fd and calls dispatch() when it becomes readable, which
+resumes the coroutine on the loop's thread. No thread is started and an
+await allocates nothing: the awaiter lives in the coroutine frame and a
+batch is copied out of the ring into an array allocated up front. A
+batch stays valid until the next nextBatch(), take() or pull().
+
+The buffer_policy and its counters (getDropped(), getOverwritten(), ...)
+apply as with the consumer thread, and the sample after lost ones is
+flagged SAMPLE_GAP. Block ends aren't queued.
+
+The awaitables need C++20 coroutines; the rest of the class works
+without them. One coroutine may wait at a time. Without coroutines the
+sink is a range of samples, see LSM9DS1_Range.h and setBlocking(); a
+sink is consumed either way, not both.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Async_H__
+#define __LSM9DS1_Async_H__
+
+#include <stdint.h>
+#include <atomic>
+#include "LSM9DS1_Sample.h"
+#include "LSM9DS1_Buffer.h"
+#include "LSM9DS1_Range.h"
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define LSM9DS1_COROUTINES
+#endif
+#endif
+
+// Samples taken from the ring, in acquisition order.
+struct LSM9DS1sampleBatch
+{
+	const LSM9DS1sample* samples;
+	unsigned n;
+
+	const LSM9DS1sample* begin() const {
+		return samples;
+	}
+	const LSM9DS1sample* end() const {
+		return samples + n;
+	}
+	unsigned size() const {
+		return n;
+	}
+};
+
+class LSM9DS1asyncSink : public LSM9DS1bufferedSink, public LSM9DS1sampleStream {
+public:
+	// Allocates the ring and the batch and creates the eventfd.
+	// Input:
+	//    - capacity = samples in the ring, also the largest batch
+	//    - policy = what to do when the coroutine falls behind
+	LSM9DS1asyncSink(unsigned capacity = 1024,
+			 buffer_policy policy = BUFFER_DROP_NEWEST);
+	~LSM9DS1asyncSink();
+
+	// Block ends aren't queued
+	virtual void blockEnd() {}
+
+	// getFd() -- Readable when a waiting coroutine can be resumed.
+	int getFd() const {
+		return fd;
+	}
+
+	// dispatch() -- Resumes the waiting coroutine if there are samples.
+	// Call it from the event loop when getFd() is readable.
+	void dispatch();
+
+	// take() -- The samples waiting now without waiting for more, maybe
+	// none. Replaces the previous batch.
+	// Input:
+	//    - max = most samples to take, 0 for all
+	LSM9DS1sampleBatch take(unsigned max = 0);
+
+	// setBlocking() -- Whether pull() waits for the next sample or
+	// returns NULL when there is none, ending the range. Non-blocking
+	// by default.
+	void setBlocking(bool blocking) {
+		this->blocking = blocking;
+	}
+
+	// pull() -- The next sample, copied out of the ring into the batch,
+	// see LSM9DS1_Range.h.
+	virtual const LSM9DS1sample* pull();
+
+	// finish() -- Lets a blocking pull() return NULL once the ring is
+	// empty, from any thread.
+	void finish();
+
+#ifdef LSM9DS1_COROUTINES
+	class BatchAwaiter {
+	public:
+		BatchAwaiter(LSM9DS1asyncSink& sink, unsigned max) : sink(sink), max(max) {}
+		bool await_ready() {
+			return sink.available() > 0;
+		}
+		bool await_suspend(std::coroutine_handle<> handle) {
+			return sink.suspend(handle.address(), resumeHandle);
+		}
+		LSM9DS1sampleBatch await_resume() {
+			return sink.take(max);
+		}
+	private:
+		static void resumeHandle(void* address) {
+			std::coroutine_handle<>::from_address(address).resume();
+		}
+		LSM9DS1asyncSink& sink;
+		unsigned max;
+	};
+
+	// nextBatch() -- Awaits the next samples and returns all waiting
+	// ones, at most max (0 for all). Replaces the previous batch.
+	BatchAwaiter nextBatch(unsigned max = 0) {
+		return BatchAwaiter(*this, max);
+	}
+#endif
+
+protected:
+	LSM9DS1sample* batch;
+	int fd;
+	// A coroutine waits: the producer wakes the event loop once
+	std::atomic<bool> armed;
+	void* waiting = nullptr;
+	void (*resume)(void*) = nullptr;
+	bool blocking = false;
+	std::atomic<bool> finished;
+
+	uint64_t available() const {
+		return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+	}
+
+	// wake() -- Wakes the event loop if a coroutine waits.
+	virtual void wake();
+
+	// suspend() -- Registers the coroutine.
+	// Output: false if samples came in meanwhile and it continues at once.
+	bool suspend(void* handle, void (*resumeFunction)(void*));
+};
+
+#endif
@@ -0,0 +1,178 @@
+/******************************************************************************
+LSM9DS1_Batch.cpp
+Work-stealing batch reprocessing.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "LSM9DS1_Batch.h"
+#include "LSM9DS1_LogIndex.h"
+
+static const uint64_t nsPerSecond = 1000000000;
+
+// Keeps the samples of a segment, dropping the warm-up output.
+class LSM9DS1segmentCollector : public LSM9DS1sampleSink {
+public:
+    LSM9DS1segmentCollector(uint64_t from, std::vector<LSM9DS1sample>& result)
+        : from(from), result(result) {}
+    virtual void hasSample(const LSM9DS1sample& sample) {
+        if (sample.timestamp >= from) result.push_back(sample);
+    }
+protected:
+    uint64_t from;
+    std::vector<LSM9DS1sample>& result;
+};
+
+// Segment queue of one worker. The owner works from the front, thieves
+// take from the back.
+struct LSM9DS1workQueue {
+    std::mutex mutex;
+    std::deque<size_t> segments;
+
+    // Both only hand out segments before limit, the end of the window
+    bool pop(size_t& s, size_t limit) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (segments.empty() || (segments.front() >= limit)) return false;
+        s = segments.front();
+        segments.pop_front();
+        return true;
+    }
+
+    bool steal(size_t& s, size_t limit) {
+        std::lock_guard<std::mutex> lock(mutex);
+        // The newest one inside the window, the queue is in order
+        for (size_t i = segments.size(); i > 0; i--) {
+            if (segments[i - 1] < limit) {
+                s = segments[i - 1];
+                segments.erase(segments.begin() + (i - 1));
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+LSM9DS1batch::LSM9DS1batch(std::function<void(LSM9DS1pipeline&)> setup,
+                           unsigned segmentSeconds, unsigned warmupSeconds,
+                           unsigned nThreads, unsigned window)
+    : setup(setup),
+      segmentNs((segmentSeconds ? segmentSeconds : 1) * nsPerSecond),
+      warmupNs(warmupSeconds * nsPerSecond),
+      nThreads(nThreads),
+      window(window)
+{
+    if (this->nThreads == 0) this->nThreads = std::thread::hardware_concurrency();
+    if (this->nThreads == 0) this->nThreads = 1;
+    if (this->window == 0) this->window = 2 * this->nThreads;
+}
+
+void LSM9DS1batch::process(const std::vector<std::string>& logs, Segment& segment)
+{
+    LSM9DS1segmentCollector collector(segment.from, segment.result);
+    LSM9DS1pipeline pipeline;
+    setup(pipeline);
+    pipeline.setOutput(&collector);
+    LSM9DS1logWindow window(logs[segment.log].c_str(), segment.warmup, segment.to);
+    LSM9DS1sample sample;
+    while (window.next(sample)) pipeline.hasSample(sample);
+}
+
+unsigned long LSM9DS1batch::run(const std::vector<std::string>& logs)
+{
+    // Cut the logs into segments along their index
+    std::vector<Segment> segments;
+    for (size_t l = 0; l < logs.size(); l++) {
+        LSM9DS1logIndex index(logs[l].c_str());
+        const std::vector<LSM9DS1logIndexEntry>& entries = index.getEntries();
+        if (entries.empty()) continue;
+        const uint64_t first = entries.front().timestamp;
+        const uint64_t last = entries.back().timestamp;
+        for (uint64_t from = first; from <= last; from += segmentNs) {
+            Segment s;
+            s.log = l;
+            s.from = (from == first) ? 0 : from;
+            s.to = (from + segmentNs > last) ? UINT64_MAX : from + segmentNs - 1;
+            s.warmup = (s.from > warmupNs) ? s.from - warmupNs : 0;
+            segments.push_back(s);
+        }
+    }
+
+    // Deal them out round robin so that the oldest ones finish first
+    std::vector<LSM9DS1workQueue> queues(nThreads);
+    for (size_t i = 0; i < segments.size(); i++)
+        queues[i % nThreads].segments.push_back(i);
+
+    std::mutex doneMutex;
+    std::condition_variable doneCond;
+    const char* error = NULL;
+    // Segments delivered and not yet taken by a worker
+    size_t delivered = 0;
+    size_t unclaimed = segments.size();
+
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < nThreads; w++) {
+        workers.push_back(std::thread([&, w]() {
+            size_t s;
+            for (;;) {
+                size_t limit;
+                {
+                    std::lock_guard<std::mutex> lock(doneMutex);
+                    if (error || (unclaimed == 0)) return;
+                    limit = delivered + window;
+                }
+                bool found = queues[w].pop(s, limit);
+                for (unsigned v = 1; (!found) && (v < nThreads); v++)
+                    found = queues[(w + v) % nThreads].steal(s, limit);
+                std::unique_lock<std::mutex> lock(doneMutex);
+                if (!found) {
+                    // All segments left are beyond the window: wait for
+                    // the delivery to catch up
+                    doneCond.wait(lock, [&]() {
+                        return error || (unclaimed == 0) || (delivered + window != limit);
+                    });
+                    continue;
+                }
+                unclaimed--;
+                lock.unlock();
+                try {
+                    process(logs, segments[s]);
+                } catch (const char* e) {
+                    std::lock_guard<std::mutex> lock(doneMutex);
+                    error = e;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(doneMutex);
+                    segments[s].done = true;
+                }
+                doneCond.notify_all();
+            }
+        }));
+    }
+
+    // Deliver in order while the workers carry on
+    unsigned long n = 0;
+    for (size_t i = 0; i < segments.size(); i++) {
+        {
+            std::unique_lock<std::mutex> lock(doneMutex);
+            doneCond.wait(lock, [&]() { return segments[i].done; });
+            if (error) break;
+        }
+        Segment& s = segments[i];
+        for (size_t j = 0; j < s.result.size(); j++) dispatch(s.result[j]);
+        n += s.result.size();
+        std::vector<LSM9DS1sample>().swap(s.result);
+        {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            delivered = i + 1;
+        }
+        doneCond.notify_all();
+    }
+
+    for (size_t w = 0; w < workers.size(); w++) workers[w].join();
+    if (error) throw error;
+    return n;
+}
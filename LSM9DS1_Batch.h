@@ -0,0 +1,69 @@
+/******************************************************************************
+LSM9DS1_Batch.h
+Parallel offline reprocessing of recorded LSM9DS1 logs.
+
+The logs are cut into segments of fixed duration along their time index.
+Segments are spread over all cores by a work-stealing scheduler: every
+worker takes the oldest segment of its own queue and steals the newest of
+another queue once its own is empty. Workers only take segments within a
+window after the oldest one not yet delivered, so that the decoded results
+waiting for their turn stay bounded. Each segment runs through its own
+instance of the pipeline, built by the same setup function as the live
+one. To give stateful stages (filters) the same state as in a continuous
+run the pipeline is fed a warm-up period before the segment starts whose
+output is discarded.
+
+The results are handed to the sample sink and the callback in the original
+order, converted exactly like the live data (LSM9DS1source::dispatch()).
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Batch_H__
+#define __LSM9DS1_Batch_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include "LSM9DS1_Source.h"
+#include "LSM9DS1_Pipeline.h"
+
+class LSM9DS1batch : public LSM9DS1source {
+public:
+	// Input:
+	//    - setup = adds the processing stages to an empty pipeline. It is
+	//      called once per segment, possibly from several threads at once.
+	//    - segmentSeconds = duration of a segment
+	//    - warmupSeconds = data fed into the pipeline before a segment
+	//      starts. Should cover the settling time of the filters.
+	//    - nThreads = number of workers, 0 for one per core
+	//    - window = segments decoded ahead of the delivery, 0 for two per
+	//      worker. At most this many segment results are held in memory.
+	LSM9DS1batch(std::function<void(LSM9DS1pipeline&)> setup,
+		     unsigned segmentSeconds = 60,
+		     unsigned warmupSeconds = 5,
+		     unsigned nThreads = 0,
+		     unsigned window = 0);
+
+	// run() -- Reprocesses the logs, which need a time index. Logs are
+	// treated as separate recordings and delivered in the given order.
+	// Output: number of samples delivered.
+	unsigned long run(const std::vector<std::string>& logs);
+
+protected:
+	struct Segment {
+		size_t log;
+		uint64_t from, to;	// samples in [from, to]
+		uint64_t warmup;	// first sample fed into the pipeline
+		std::vector<LSM9DS1sample> result;
+		bool done = false;
+	};
+	std::function<void(LSM9DS1pipeline&)> setup;
+	uint64_t segmentNs, warmupNs;
+	unsigned nThreads;
+	unsigned window;
+	void process(const std::vector<std::string>& logs, Segment& segment);
+};
+
+#endif
@@ -0,0 +1,86 @@
+/******************************************************************************
+LSM9DS1_Block.cpp
+Transposition of samples into structure-of-arrays blocks.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "LSM9DS1_Block.h"
+
+LSM9DS1blockSink::LSM9DS1blockSink(LSM9DS1blockConsumer* consumer, unsigned blockSize,
+                                   bool splitAtBlockEnd)
+    : consumer(consumer), splitAtBlockEnd(splitAtBlockEnd)
+{
+    if (blockSize < 1) blockSize = 1;
+    if (blockSize > 65536) blockSize = 65536;
+    this->blockSize = 1;
+    while (this->blockSize < blockSize) this->blockSize <<= 1;
+    // 32 int16 fill a cache line
+    const size_t padded = (this->blockSize + 31) & ~31u;
+    const size_t bytes = padded * (sizeof(uint64_t) + 9 * sizeof(int16_t) + sizeof(uint16_t));
+    memory = aligned_alloc(LSM9DS1block::alignment, bytes);
+    if (!memory) throw "Could not allocate the block arrays.";
+    // Zero, which also touches the pages now rather than in the acquisition
+    memset(memory, 0, bytes);
+    uint8_t* p = (uint8_t*)memory;
+    block.timestamp = (uint64_t*)p;
+    p += padded * sizeof(uint64_t);
+    int16_t** channels[3] = {block.g, block.a, block.m};
+    for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < 3; i++) {
+            channels[c][i] = (int16_t*)p;
+            p += padded * sizeof(int16_t);
+        }
+    }
+    block.flags = (uint16_t*)p;
+    block.n = 0;
+    block.padded = (unsigned)padded;
+    block.scale = 0;
+}
+
+LSM9DS1blockSink::~LSM9DS1blockSink()
+{
+    free(memory);
+}
+
+void LSM9DS1blockSink::hasSample(const LSM9DS1sample& sample)
+{
+    if (block.n && (sample.scale != block.scale)) flush();
+    const unsigned i = block.n;
+    block.timestamp[i] = sample.timestamp;
+    for (int j = 0; j < 3; j++) {
+        block.g[j][i] = sample.g[j];
+        block.a[j][i] = sample.a[j];
+        block.m[j][i] = sample.m[j];
+    }
+    block.flags[i] = sample.flags;
+    block.scale = sample.scale;
+    if (++block.n == blockSize) flush();
+}
+
+void LSM9DS1blockSink::blockEnd()
+{
+    if (splitAtBlockEnd) flush();
+}
+
+void LSM9DS1blockSink::flush()
+{
+    if (!block.n) return;
+    // Zero the padding after a short block: the previous one may have
+    // left samples there
+    const unsigned n = block.n;
+    const size_t rest = block.padded - n;
+    if (rest) {
+        memset(block.timestamp + n, 0, rest * sizeof(uint64_t));
+        for (int j = 0; j < 3; j++) {
+            memset(block.g[j] + n, 0, rest * sizeof(int16_t));
+            memset(block.a[j] + n, 0, rest * sizeof(int16_t));
+            memset(block.m[j] + n, 0, rest * sizeof(int16_t));
+        }
+        memset(block.flags + n, 0, rest * sizeof(uint16_t));
+    }
+    if (consumer) consumer->hasBlock(block);
+    block.n = 0;
+}
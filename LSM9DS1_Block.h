@@ -0,0 +1,81 @@
+/******************************************************************************
+LSM9DS1_Block.h
+Structure-of-arrays blocks of samples for vectorised processing.
+
+LSM9DS1blockSink collects the samples into blocks with one array per
+channel: timestamps, gx, gy, gz, ax, ... Every array starts on a cache
+line and is padded with zeros to a whole number of cache lines, so that
+filters, FFTs and statistics can run SIMD loads over full vectors
+without gathers or a scalar tail. A block is closed when it is full,
+at the end of a FIFO drain (blockEnd()) and when the full scales
+change, so all samples of a block share one scale and one conversion
+factor per sensor.
+
+It is a sample sink: put it behind the device, a buffered sink, a
+replay or a batch run. The arrays are allocated once, delivering a
+block does not allocate.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Block_H__
+#define __LSM9DS1_Block_H__
+
+#include <stdint.h>
+#include "LSM9DS1_Sample.h"
+
+struct LSM9DS1block
+{
+	// Alignment of the arrays and multiple their sizes are padded to
+	static const unsigned alignment = 64;
+
+	unsigned n;		// samples in the block
+	unsigned padded;	// elements in each array, multiple of 32
+	uint8_t scale;		// full scales of all samples, see LSM9DS1source::scaleCode()
+	uint64_t* timestamp;	// CLOCK_MONOTONIC in nanoseconds
+	int16_t* g[3];		// raw gyroscope x, y, z
+	int16_t* a[3];		// raw accelerometer x, y, z
+	int16_t* m[3];		// raw magnetometer x, y, z
+	uint16_t* flags;	// OR'd sample_flags
+};
+
+class LSM9DS1blockSink;
+
+class LSM9DS1blockConsumer {
+public:
+	// Called with every block. The block is only valid during the call.
+	virtual void hasBlock(const LSM9DS1block& block) = 0;
+
+	virtual ~LSM9DS1blockConsumer() {}
+};
+
+class LSM9DS1blockSink : public LSM9DS1sampleSink {
+public:
+	// Input:
+	//    - consumer = receives the blocks
+	//    - blockSize = samples per block, rounded up to a power of two.
+	//      The default is the depth of the FIFO.
+	//    - splitAtBlockEnd = close a block at the end of every FIFO drain
+	LSM9DS1blockSink(LSM9DS1blockConsumer* consumer, unsigned blockSize = 32,
+			 bool splitAtBlockEnd = true);
+	~LSM9DS1blockSink();
+
+	virtual void hasSample(const LSM9DS1sample& sample);
+	virtual void blockEnd();
+
+	// flush() -- Delivers the samples collected so far as a block.
+	void flush();
+
+	unsigned getBlockSize() const {
+		return blockSize;
+	}
+
+protected:
+	LSM9DS1blockConsumer* consumer;
+	unsigned blockSize;
+	bool splitAtBlockEnd;
+	LSM9DS1block block;
+	void* memory;
+};
+
+#endif
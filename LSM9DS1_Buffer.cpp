@@ -0,0 +1,179 @@
+/******************************************************************************
+LSM9DS1_Buffer.cpp
+Single producer / single consumer ring between acquisition and processing.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <time.h>
+#include "LSM9DS1_Buffer.h"
+#include "LSM9DS1_Trace.h"
+
+LSM9DS1bufferedSink::LSM9DS1bufferedSink(LSM9DS1sampleSink* sink, unsigned capacity,
+                                         buffer_policy policy)
+    : LSM9DS1bufferedSink(sink, capacity, policy, true)
+{
+}
+
+LSM9DS1bufferedSink::LSM9DS1bufferedSink(LSM9DS1sampleSink* sink, unsigned capacity,
+                                         buffer_policy policy, bool consumerThread)
+    : sink(sink), capacity(capacity ? capacity : 1), policy(policy), head(0), tail(0),
+      dropped(0), overwritten(0), decimated(0), blocked(0), running(true)
+{
+    ring = new Entry[this->capacity];
+    // Touch the ring now rather than in the signal handler
+    for (uint64_t i = 0; i < this->capacity; i++) ring[i] = Entry();
+    if (sem_init(&wakeup, 0, 0) < 0) {
+        delete[] ring;
+        throw "Could not create buffer semaphore.";
+    }
+    if (sem_init(&space, 0, 0) < 0) {
+        sem_destroy(&wakeup);
+        delete[] ring;
+        throw "Could not create buffer semaphore.";
+    }
+    if (consumerThread)
+        this->consumerThread = std::thread(&LSM9DS1bufferedSink::consumeLoop, this);
+}
+
+LSM9DS1bufferedSink::~LSM9DS1bufferedSink()
+{
+    running = false;
+    sem_post(&wakeup);
+    if (consumerThread.joinable()) consumerThread.join();
+    sem_destroy(&wakeup);
+    sem_destroy(&space);
+    delete[] ring;
+}
+
+// Runs in the acquisition context: no locks, no allocation and only
+// async-signal-safe calls; only BUFFER_BLOCK waits. A NULL sample
+// queues a block end.
+bool LSM9DS1bufferedSink::push(const LSM9DS1sample* sample)
+{
+    const uint64_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= capacity) {
+        switch (policy) {
+        case BUFFER_DROP_OLDEST:
+            dropOldest();
+            break;
+        case BUFFER_BLOCK:
+            blocked++;
+            for (;;) {
+                // Announce the wait, then look again: either this sees
+                // the room or the consumer sees the flag and posts
+                waiting = true;
+                if (h - tail.load() < capacity) break;
+                if (!running) return false;
+                sem_wait(&space);
+            }
+            waiting = false;
+            break;
+        default:
+            return false;
+        }
+    }
+    Entry& e = ring[h % capacity];
+    e.blockEnd = !sample;
+    if (sample) e.sample = *sample;
+    head.store(h + 1, std::memory_order_release);
+    wake();
+    return true;
+}
+
+void LSM9DS1bufferedSink::wake()
+{
+    sem_post(&wakeup);
+}
+
+// Takes the oldest entry away from the consumer. The consumer copies an
+// entry before it claims it, so it notices when it lost the race.
+void LSM9DS1bufferedSink::dropOldest()
+{
+    uint64_t t = tail.load(std::memory_order_acquire);
+    const bool blockEnd = ring[t % capacity].blockEnd;
+    // Fails only if the consumer claimed it first, which makes room as well
+    if (tail.compare_exchange_strong(t, t + 1, std::memory_order_acq_rel) && !blockEnd)
+        overwritten++;
+}
+
+void LSM9DS1bufferedSink::hasSample(const LSM9DS1sample& sample)
+{
+    if (policy == BUFFER_DECIMATE) {
+        const uint64_t fill = head.load(std::memory_order_relaxed) -
+            tail.load(std::memory_order_relaxed);
+        unsigned keep = 1;
+        if (fill * 4 >= capacity * 3) keep = 4;
+        else if (fill * 2 >= capacity) keep = 2;
+        if ((decimateCount++ % keep) != 0) {
+            decimated++;
+            gap = true;
+            return;
+        }
+    }
+    if (gap) {
+        LSM9DS1sample s = sample;
+        s.flags |= SAMPLE_GAP;
+        if (push(&s)) gap = false;
+        else dropped++;
+    } else if (!push(&sample)) {
+        dropped++;
+        gap = true;
+    }
+}
+
+void LSM9DS1bufferedSink::blockEnd()
+{
+    push(NULL);
+}
+
+void LSM9DS1bufferedSink::consumeLoop()
+{
+#ifdef LSM9DS1_TRACE
+    try {
+        LSM9DS1tracer::registerThread("lsm9ds1 buffer");
+    } catch (const char*) {
+        // Not traced
+    }
+#endif
+    for (;;) {
+        sem_wait(&wakeup);
+        // One post per entry: take them all, the loop below empties the ring
+        while (sem_trywait(&wakeup) == 0);
+        const bool stopping = !running;
+        Entry e;
+        while (takeEntry(e)) {
+            LSM9DS1_TRACE_SCOPE("buffer");
+            if (e.blockEnd) {
+                if (sink) sink->blockEnd();
+            } else {
+                if (sink) sink->hasSample(e.sample);
+            }
+        }
+        if (stopping) return;
+    }
+}
+
+bool LSM9DS1bufferedSink::takeEntry(Entry& e)
+{
+    uint64_t t = tail.load(std::memory_order_acquire);
+    if (t != expected) lostOldest = true;
+    while (t < head.load(std::memory_order_acquire)) {
+        // Copy, then claim: with BUFFER_DROP_OLDEST the producer may
+        // have taken the entry in the meantime and be overwriting it
+        e = ring[t % capacity];
+        if (!tail.compare_exchange_strong(t, t + 1, std::memory_order_acq_rel)) {
+            // t is the new tail now, samples were lost before it
+            lostOldest = true;
+            continue;
+        }
+        expected = t + 1;
+        if (waiting.exchange(false)) sem_post(&space);
+        if ((!e.blockEnd) && lostOldest) {
+            e.sample.flags |= SAMPLE_GAP;
+            lostOldest = false;
+        }
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,132 @@
+/******************************************************************************
+LSM9DS1_Buffer.h
+Hands samples from the acquisition over to a thread of their own.
+
+The timer event runs in a signal handler, so anything slow behind it
+(files, networking, heavy filters) delays the next reading. The buffered
+sink takes the samples into a single producer / single consumer ring
+allocated up front and delivers them to the wrapped sink from a
+consumer thread. What happens when the consumer falls behind is up to
+the buffer_policy; each policy counts what it did and the sample after
+any lost ones is flagged SAMPLE_GAP. Except for BUFFER_BLOCK the
+producer never waits, so the acquisition keeps its timing whatever the
+consumer does. Derived classes can consume the ring themselves instead
+of the thread, see LSM9DS1_Async.h.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Buffer_H__
+#define __LSM9DS1_Buffer_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <semaphore.h>
+#include "LSM9DS1_Sample.h"
+
+// What the buffered sink does with a sample when the consumer is behind
+enum buffer_policy
+{
+	BUFFER_DROP_NEWEST = 0,	// a full ring drops the new sample
+	BUFFER_DROP_OLDEST,	// a full ring discards its oldest sample
+	BUFFER_BLOCK,		// the producer waits for room. Offline replay
+				// only: never in the timer's signal handler
+	BUFFER_DECIMATE,	// from half full on only every 2nd, from 3/4
+				// on every 4th sample is queued; a full ring
+				// drops the new sample
+};
+
+class LSM9DS1bufferedSink : public LSM9DS1sampleSink {
+public:
+	// Allocates the ring and starts the consumer thread.
+	// Input:
+	//    - sink = receives the samples and block ends in the consumer thread
+	//    - capacity = entries in the ring, one per sample or block end
+	//    - policy = what to do when the consumer falls behind
+	LSM9DS1bufferedSink(LSM9DS1sampleSink* sink, unsigned capacity = 1024,
+			    buffer_policy policy = BUFFER_DROP_NEWEST);
+	// Delivers what is left in the ring and stops the thread.
+	~LSM9DS1bufferedSink();
+
+	virtual void hasSample(const LSM9DS1sample& sample);
+	virtual void blockEnd();
+
+	// Number of new samples dropped because the ring was full.
+	unsigned long getDropped() const {
+		return dropped;
+	}
+
+	// Number of queued samples discarded by BUFFER_DROP_OLDEST.
+	unsigned long getOverwritten() const {
+		return overwritten;
+	}
+
+	// Number of samples skipped by BUFFER_DECIMATE.
+	unsigned long getDecimated() const {
+		return decimated;
+	}
+
+	// Number of times BUFFER_BLOCK made the producer wait.
+	unsigned long getBlocked() const {
+		return blocked;
+	}
+
+	// Number of entries waiting for the consumer.
+	unsigned getFill() const {
+		return (unsigned)(head.load(std::memory_order_relaxed) -
+				  tail.load(std::memory_order_relaxed));
+	}
+
+protected:
+	struct Entry {
+		LSM9DS1sample sample;
+		bool blockEnd;
+	};
+
+	// For a derived class which consumes the ring itself: no consumer
+	// thread is started if consumerThread is false.
+	LSM9DS1bufferedSink(LSM9DS1sampleSink* sink, unsigned capacity,
+			    buffer_policy policy, bool consumerThread);
+
+	LSM9DS1sampleSink* sink;
+	uint64_t capacity;
+	buffer_policy policy;
+	Entry* ring;
+	std::atomic<uint64_t> head;	// entries written so far
+	// Entries delivered or discarded so far. Moved on by the consumer
+	// and, with BUFFER_DROP_OLDEST, by the producer.
+	std::atomic<uint64_t> tail;
+	std::atomic<unsigned long> dropped;
+	std::atomic<unsigned long> overwritten;
+	std::atomic<unsigned long> decimated;
+	std::atomic<unsigned long> blocked;
+	std::atomic<bool> running;
+	// Producer side: samples have been dropped since the last one queued
+	bool gap = false;
+	// Producer side: samples seen while decimating
+	unsigned decimateCount = 0;
+	sem_t wakeup;
+	// BUFFER_BLOCK: the producer waits for space, posted by the consumer
+	std::atomic<bool> waiting{false};
+	sem_t space;
+	std::thread consumerThread;
+	// Consumer side: samples were discarded by BUFFER_DROP_OLDEST before
+	// the next one, and where the tail is unless the producer moved it
+	bool lostOldest = false;
+	uint64_t expected = 0;
+	bool push(const LSM9DS1sample* sample);
+	void dropOldest();
+	void consumeLoop();
+
+	// takeEntry() -- Consumer side: takes the oldest entry out of the
+	// ring, flagged SAMPLE_GAP if samples were lost before it.
+	// Output: false if the ring is empty.
+	bool takeEntry(Entry& entry);
+
+	// wake() -- Tells the consumer that an entry has been queued. Called
+	// in the acquisition context, posts the consumer thread's semaphore.
+	virtual void wake();
+};
+
+#endif
@@ -0,0 +1,73 @@
+/******************************************************************************
+LSM9DS1_Command.cpp
+Bounded multi producer / single consumer command queue.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include "LSM9DS1_Command.h"
+
+LSM9DS1commandQueue::LSM9DS1commandQueue() : head(0)
+{
+    for (unsigned i = 0; i < capacity; i++) slots[i].seq.store(i, std::memory_order_relaxed);
+}
+
+bool LSM9DS1commandQueue::post(const LSM9DS1command* commands, unsigned n)
+{
+    if ((n == 0) || (n > capacity)) return false;
+    uint64_t pos = head.load(std::memory_order_relaxed);
+    for (;;) {
+        // All n slots have to be free for this position
+        bool free = true;
+        bool moved = false;
+        for (unsigned i = 0; i < n; i++) {
+            const uint64_t seq = slots[(pos + i) % capacity].seq.load(std::memory_order_acquire);
+            if (seq < pos + i) {
+                free = false;
+                break;
+            }
+            if (seq > pos + i) {
+                moved = true;
+                break;
+            }
+        }
+        if (moved) {
+            // Another producer got there first
+            pos = head.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (!free) {
+            // Full, unless the head has moved on in the meantime
+            const uint64_t now = head.load(std::memory_order_relaxed);
+            if (now == pos) return false;
+            pos = now;
+            continue;
+        }
+        if (head.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) break;
+    }
+    for (unsigned i = 0; i < n; i++) {
+        Slot& slot = slots[(pos + i) % capacity];
+        slot.command = commands[i];
+        slot.group = n - i;
+        slot.seq.store(pos + i + 1, std::memory_order_release);
+    }
+    return true;
+}
+
+unsigned LSM9DS1commandQueue::take(LSM9DS1command* commands)
+{
+    Slot& first = slots[tail % capacity];
+    if (first.seq.load(std::memory_order_acquire) != tail + 1) return 0;
+    const unsigned n = first.group;
+    for (unsigned i = 1; i < n; i++) {
+        if (slots[(tail + i) % capacity].seq.load(std::memory_order_acquire) != tail + i + 1)
+            return 0;
+    }
+    for (unsigned i = 0; i < n; i++) {
+        Slot& slot = slots[(tail + i) % capacity];
+        commands[i] = slot.command;
+        slot.seq.store(tail + i + capacity, std::memory_order_release);
+    }
+    tail += n;
+    return n;
+}
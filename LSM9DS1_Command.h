@@ -0,0 +1,68 @@
+/******************************************************************************
+LSM9DS1_Command.h
+Configuration changes handed to the acquisition.
+
+Calling setGyroScale() and friends from another thread while
+timerEvent() reads the sensor mixes their bus transfers with the ones
+of the read and changes the resolutions half way through a sample.
+Instead an application thread posts commands into this queue and
+timerEvent() applies them between two reads. The queue is a bounded
+multi producer / single consumer ring (after D. Vyukov): posting
+never blocks and the acquisition never takes a lock. Commands posted
+together are applied together, in one timer event.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Command_H__
+#define __LSM9DS1_Command_H__
+
+#include <stdint.h>
+#include <atomic>
+
+enum command_type
+{
+	CMD_GYRO_SCALE = 1,	// value as setGyroScale()
+	CMD_ACCEL_SCALE,	// value as setAccelScale()
+	CMD_MAG_SCALE,		// value as setMagScale()
+	CMD_GYRO_ODR,		// value as setGyroODR()
+	CMD_ACCEL_ODR,		// value as setAccelODR()
+	CMD_MAG_ODR,		// value as setMagODR()
+};
+
+struct LSM9DS1command
+{
+	command_type type;
+	uint16_t value;
+};
+
+class LSM9DS1commandQueue {
+public:
+	static const unsigned capacity = 32;
+
+	LSM9DS1commandQueue();
+
+	// post() -- Queues n commands which are taken out together.
+	// Safe to call from any number of threads.
+	// Output: false if there is no room for all n, nothing is queued then.
+	bool post(const LSM9DS1command* commands, unsigned n);
+
+	// take() -- Takes the oldest group of commands out. Single consumer.
+	// Input:
+	//    - commands = room for capacity commands
+	// Output: number of commands, 0 if no group is complete yet.
+	unsigned take(LSM9DS1command* commands);
+
+private:
+	struct Slot {
+		// pos + 1 when filled for pos, pos + capacity when free again
+		std::atomic<uint64_t> seq;
+		LSM9DS1command command;
+		unsigned group;	// commands posted together, from this one on
+	};
+	Slot slots[capacity];
+	std::atomic<uint64_t> head;
+	uint64_t tail = 0;
+};
+
+#endif
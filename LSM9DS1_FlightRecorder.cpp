@@ -0,0 +1,140 @@
+/******************************************************************************
+LSM9DS1_FlightRecorder.cpp
+Flight recorder ring and its dump thread.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <time.h>
+#include "LSM9DS1_FlightRecorder.h"
+#include "LSM9DS1_Log.h"
+
+// The dump thread is woken up every that many samples while dumping
+static const uint64_t wakeupInterval = 32;
+
+LSM9DS1flightRecorder::LSM9DS1flightRecorder(const char* prefix, const IMUSettings& settings,
+                                             double sampleRate, double preSeconds,
+                                             double postSeconds)
+    : prefix(prefix), settings(settings), head(0), dumpStart(0), dumpEnd(0),
+      triggerRequested(false), running(true), dumps(0), lost(0)
+{
+    preSamples = (uint64_t)(sampleRate * preSeconds);
+    postSamples = (uint64_t)(sampleRate * postSeconds);
+    capacity = preSamples + postSamples + (uint64_t)sampleRate + 1;
+    ring = new LSM9DS1sample[capacity];
+    // Touch the ring now rather than on the first wrap around
+    for (uint64_t i = 0; i < capacity; i++) ring[i] = LSM9DS1sample();
+    if (sem_init(&wakeup, 0, 0) < 0) {
+        delete[] ring;
+        throw "Could not create flight recorder semaphore.";
+    }
+    dumpThread = std::thread(&LSM9DS1flightRecorder::dumpLoop, this);
+}
+
+LSM9DS1flightRecorder::~LSM9DS1flightRecorder()
+{
+    running = false;
+    sem_post(&wakeup);
+    dumpThread.join();
+    sem_destroy(&wakeup);
+    delete[] ring;
+}
+
+// Runs in the acquisition context: no locks, no allocation and only
+// async-signal-safe calls.
+void LSM9DS1flightRecorder::hasSample(const LSM9DS1sample& sample)
+{
+    const uint64_t h = head.load(std::memory_order_relaxed);
+    ring[h % capacity] = sample;
+    head.store(h + 1, std::memory_order_release);
+
+    const bool fire = triggerRequested.exchange(false) ||
+        (accelInt && (sample.flags & SAMPLE_ACCEL_INT)) ||
+        (detector && detector(sample));
+    if (fire) {
+        const uint64_t end = h + 1 + postSamples;
+        uint64_t current = dumpEnd.load(std::memory_order_acquire);
+        for (;;) {
+            if (current == 0) {
+                // New dump: starts with the history before the event
+                dumpStart.store((h + 1 > preSamples) ? h + 1 - preSamples : 0,
+                                std::memory_order_relaxed);
+                if (dumpEnd.compare_exchange_weak(current, end)) {
+                    sem_post(&wakeup);
+                    break;
+                }
+            } else {
+                // Running dump: extend it
+                if ((end <= current) || dumpEnd.compare_exchange_weak(current, end)) break;
+            }
+        }
+    }
+
+    const uint64_t end = dumpEnd.load(std::memory_order_relaxed);
+    if (end && ((((h + 1) % wakeupInterval) == 0) || (h + 1 == end))) sem_post(&wakeup);
+}
+
+void LSM9DS1flightRecorder::dumpLoop()
+{
+    LSM9DS1logWriter* writer = NULL;
+    uint64_t next = 0;
+    unsigned long n = 0;
+    for (;;) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += 100000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        sem_timedwait(&wakeup, &ts);
+        const bool stopping = !running;
+
+        for (;;) {
+            uint64_t end = dumpEnd.load(std::memory_order_acquire);
+            if (!writer) {
+                if (!end) break;
+                next = dumpStart.load(std::memory_order_relaxed);
+                const std::string name = prefix + "-" + std::to_string(++n) + ".log";
+                try {
+                    writer = new LSM9DS1logWriter(name.c_str(), settings, 32, 0, false);
+                } catch (const char*) {
+                    // Can't write: drop the dump
+                    lost += end - next;
+                    dumpEnd.compare_exchange_strong(end, 0);
+                    continue;
+                }
+            }
+
+            const uint64_t h = head.load(std::memory_order_acquire);
+            if (next + capacity < h) {
+                lost += h - capacity - next;
+                next = h - capacity;
+            }
+            const uint64_t limit = (h < end) ? h : end;
+            while (next < limit) {
+                const LSM9DS1sample s = ring[next % capacity];
+                // The slot may have been overwritten while it was copied
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (head.load(std::memory_order_relaxed) >= next + capacity) {
+                    lost++;
+                } else {
+                    writer->hasSample(s);
+                }
+                next++;
+            }
+
+            if ((next >= end) || stopping) {
+                // An event may just have extended the dump
+                if ((!stopping) && (!dumpEnd.compare_exchange_strong(end, 0))) continue;
+                delete writer;
+                writer = NULL;
+                dumps++;
+                if (stopping) dumpEnd = 0;
+                continue;
+            }
+            break;
+        }
+        if (stopping) return;
+    }
+}
@@ -0,0 +1,101 @@
+/******************************************************************************
+LSM9DS1_FlightRecorder.h
+Pre-trigger ring buffer which dumps the moments around an event to disk.
+
+The recorder is a sample sink which keeps the last seconds of full rate
+data in a ring allocated up front. When an event fires the history before
+it and a configurable time after it are written to a new log file by a
+background thread, so the acquisition never waits for the SD card.
+
+Events are
+    - an explicit trigger() from any thread,
+    - a software detector called with every sample,
+    - samples flagged SAMPLE_ACCEL_INT, i.e. the accel threshold interrupt
+      set up with configAccelInt() / configAccelThs() while the device
+      polls it (LSM9DS1::pollAccelInt()).
+An event during a dump extends it.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_FlightRecorder_H__
+#define __LSM9DS1_FlightRecorder_H__
+
+#include <stdint.h>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <semaphore.h>
+#include "LSM9DS1_Types.h"
+#include "LSM9DS1_Sample.h"
+
+class LSM9DS1flightRecorder : public LSM9DS1sampleSink {
+public:
+	// Allocates the ring and starts the dump thread.
+	// Input:
+	//    - prefix = dumps are written to <prefix>-<n>.log, n = 1, 2, ...
+	//    - settings = of the recorded device, stored in the dumps
+	//    - sampleRate = samples per second arriving at the recorder
+	//    - preSeconds = history kept before an event
+	//    - postSeconds = data recorded after an event
+	// The ring holds preSeconds + postSeconds plus one second of slack
+	// for the dump thread.
+	LSM9DS1flightRecorder(const char* prefix, const IMUSettings& settings,
+			      double sampleRate, double preSeconds, double postSeconds);
+	// Writes out a running dump as far as data has arrived.
+	~LSM9DS1flightRecorder();
+
+	virtual void hasSample(const LSM9DS1sample& sample);
+
+	// trigger() -- Fires an event at the next sample. Thread safe.
+	void trigger() {
+		triggerRequested = true;
+	}
+
+	// setDetector() -- Software detector, called with every sample.
+	// It fires an event by returning true. Set it before streaming.
+	void setDetector(std::function<bool(const LSM9DS1sample&)> detector) {
+		this->detector = detector;
+	}
+
+	// triggerOnAccelInt() -- Fire on samples flagged SAMPLE_ACCEL_INT.
+	// On by default.
+	void triggerOnAccelInt(bool enable = true) {
+		accelInt = enable;
+	}
+
+	// Number of dumps written completely.
+	unsigned long getDumps() const {
+		return dumps;
+	}
+
+	// Number of samples which were overwritten before they were dumped.
+	unsigned long getLostSamples() const {
+		return lost;
+	}
+
+	bool isDumping() const {
+		return dumpEnd != 0;
+	}
+
+protected:
+	std::string prefix;
+	IMUSettings settings;
+	uint64_t capacity, preSamples, postSamples;
+	LSM9DS1sample* ring;
+	std::atomic<uint64_t> head;	// samples written so far
+	std::atomic<uint64_t> dumpStart;
+	std::atomic<uint64_t> dumpEnd;	// one past the last sample to dump, 0 = idle
+	std::atomic<bool> triggerRequested;
+	std::atomic<bool> running;
+	std::atomic<unsigned long> dumps;
+	std::atomic<unsigned long> lost;
+	bool accelInt = true;
+	std::function<bool(const LSM9DS1sample&)> detector;
+	sem_t wakeup;
+	std::thread dumpThread;
+	void dumpLoop();
+};
+
+#endif
@@ -0,0 +1,90 @@
+/******************************************************************************
+LSM9DS1_Latency.cpp
+Log-linear histograms for the latency measurements.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <time.h>
+#include "LSM9DS1_Latency.h"
+
+LSM9DS1histogram::LSM9DS1histogram()
+{
+    reset();
+}
+
+unsigned LSM9DS1histogram::bucketOf(uint64_t ns)
+{
+    if (ns < subBuckets) return (unsigned)ns;
+    if (ns >= ((uint64_t)1 << 32)) ns = ((uint64_t)1 << 32) - 1;
+    // e = position of the highest bit, 4..31
+    unsigned e = 63 - __builtin_clzll(ns);
+    return (e - 3) * subBuckets + (unsigned)(ns >> (e - 4)) - subBuckets;
+}
+
+uint64_t LSM9DS1histogram::bucketLow(unsigned b)
+{
+    if (b < subBuckets) return b;
+    const unsigned e = b / subBuckets + 3;
+    return (uint64_t)(subBuckets + b % subBuckets) << (e - 4);
+}
+
+uint64_t LSM9DS1histogram::bucketHigh(unsigned b)
+{
+    if (b < subBuckets) return b;
+    const unsigned e = b / subBuckets + 3;
+    return bucketLow(b) + ((uint64_t)1 << (e - 4)) - 1;
+}
+
+void LSM9DS1histogram::record(uint64_t ns)
+{
+    counts[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t m = max.load(std::memory_order_relaxed);
+    while ((ns > m) && !max.compare_exchange_weak(m, ns, std::memory_order_relaxed));
+}
+
+uint64_t LSM9DS1histogram::getCount() const
+{
+    uint64_t n = 0;
+    for (unsigned b = 0; b < nBuckets; b++) n += counts[b].load(std::memory_order_relaxed);
+    return n;
+}
+
+uint64_t LSM9DS1histogram::percentile(double p) const
+{
+    // Take a snapshot so that the walk agrees with the total
+    uint32_t snapshot[nBuckets];
+    uint64_t total = 0;
+    for (unsigned b = 0; b < nBuckets; b++) {
+        snapshot[b] = counts[b].load(std::memory_order_relaxed);
+        total += snapshot[b];
+    }
+    if (total == 0) return 0;
+    if (p < 0) p = 0;
+    if (p > 100) p = 100;
+    uint64_t target = (uint64_t)(p / 100 * total + 0.5);
+    if (target < 1) target = 1;
+    uint64_t n = 0;
+    for (unsigned b = 0; b < nBuckets; b++) {
+        n += snapshot[b];
+        if (n >= target) {
+            const uint64_t high = bucketHigh(b);
+            const uint64_t m = getMax();
+            return high < m ? high : m;
+        }
+    }
+    return getMax();
+}
+
+void LSM9DS1histogram::reset()
+{
+    for (unsigned b = 0; b < nBuckets; b++) counts[b].store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LSM9DS1latency::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,84 @@
+/******************************************************************************
+LSM9DS1_Latency.h
+Latency and jitter histograms of the acquisition path.
+
+The library measures three things per timer event: how late the event
+fired after the timer was due (wakeup), how long it spent on the bus and
+how long the sample sink and the callback took. Each goes into a
+histogram with logarithmic buckets split into 16 linear sub-buckets
+(HDR style), so values from nanoseconds to seconds are kept within 6%
+at a fixed size. Recording is a relaxed atomic increment and is safe in
+the timer's signal handler; the percentiles can be queried from any
+thread while the acquisition runs.
+
+The measurements are only compiled in when the library is built with
+cmake -DLSM9DS1_LATENCY=ON. Otherwise the histograms stay empty and the
+acquisition path contains no extra code.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Latency_H__
+#define __LSM9DS1_Latency_H__
+
+#include <stdint.h>
+#include <atomic>
+
+class LSM9DS1histogram {
+public:
+	// Linear sub-buckets per power of two
+	static const unsigned subBuckets = 16;
+	// Values up to 2^32 ns (4.3 s), larger ones are counted there
+	static const unsigned nBuckets = subBuckets * 29;
+
+	LSM9DS1histogram();
+
+	// record() -- Counts one value in ns. Lock free.
+	void record(uint64_t ns);
+
+	// percentile() -- Upper bound of the bucket holding the given
+	// percentile (0-100) of all values recorded, 0 if there are none.
+	uint64_t percentile(double p) const;
+
+	// Number of values recorded.
+	uint64_t getCount() const;
+
+	// Largest value recorded.
+	uint64_t getMax() const {
+		return max.load(std::memory_order_relaxed);
+	}
+
+	// Forgets all values.
+	void reset();
+
+	// Lowest and highest value counted in bucket b.
+	static uint64_t bucketLow(unsigned b);
+	static uint64_t bucketHigh(unsigned b);
+
+protected:
+	std::atomic<uint32_t> counts[nBuckets];
+	std::atomic<uint64_t> max;
+	static unsigned bucketOf(uint64_t ns);
+};
+
+// The histograms of one device.
+struct LSM9DS1latency
+{
+	// From the time the timer was due to timerEvent() running
+	LSM9DS1histogram wakeup;
+	// Register reads within one timer event
+	LSM9DS1histogram bus;
+	// Sample sink and callback within one timer event
+	LSM9DS1histogram callback;
+
+	void reset() {
+		wakeup.reset();
+		bus.reset();
+		callback.reset();
+	}
+
+	// now() -- CLOCK_MONOTONIC in ns
+	static uint64_t now();
+};
+
+#endif
@@ -0,0 +1,397 @@
+/******************************************************************************
+LSM9DS1_Log.cpp
+Delta / varint codec and file reader and writer for LSM9DS1 logs.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <string.h>
+#include <errno.h>
+#include <string>
+#include "LSM9DS1_Log.h"
+#include "LSM9DS1_Endian.h"
+
+static const uint8_t fileMagic[4] = {'L', 'S', 'M', '9'};
+static const uint8_t blockMagic[4] = {'L', 'S', 'M', 'B'};
+static const uint8_t indexMagic[4] = {'L', 'S', 'M', 'I'};
+
+// Number of channels stored per sample
+static const int nChannels = 9;
+
+// Maps signed to unsigned so that small magnitudes give small numbers:
+// 0, -1, 1, -2, 2 ... => 0, 1, 2, 3, 4 ...
+static inline uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t u)
+{
+    return (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+}
+
+static inline uint8_t* putVarint(uint8_t* p, uint64_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// Returns NULL if the varint runs past end.
+static inline const uint8_t* getVarint(const uint8_t* p, const uint8_t* end, uint64_t& v)
+{
+    v = 0;
+    for (int shift = 0; (p < end) && (shift < 64); shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return p;
+    }
+    return NULL;
+}
+
+// Channels in storage order: gyro, accel, mag
+static inline void getChannels(const LSM9DS1sample& s, int16_t* c)
+{
+    for (int i = 0; i < 3; i++) {
+        c[i] = s.g[i];
+        c[i + 3] = s.a[i];
+        c[i + 6] = s.m[i];
+    }
+}
+
+static inline void setChannels(LSM9DS1sample& s, const int16_t* c)
+{
+    for (int i = 0; i < 3; i++) {
+        s.g[i] = c[i];
+        s.a[i] = c[i + 3];
+        s.m[i] = c[i + 6];
+    }
+}
+
+size_t LSM9DS1logCodec::maxEncodedSize(unsigned n)
+{
+    // Timestamp: up to 10 varint bytes. Flags with the scale change:
+    // 4 bytes. A 17 bit channel delta: 3 bytes.
+    if (n == 0) return blockHeaderSize;
+    return blockHeaderSize + (n - 1) * (10 + 4 + nChannels * 3);
+}
+
+size_t LSM9DS1logCodec::encode(const LSM9DS1sample* samples, unsigned n, uint8_t* out)
+{
+    if ((n == 0) || (n > maxBlockSamples)) return 0;
+
+    // Block header:
+    // [magic 4][samples 2][flags 2][payload bytes 4][timestamp 8][channels 9*2]
+    // [scale][reserved]
+    // Payload per further sample: [interval change][flags | scale change << 16]
+    // [9 channel deltas]
+    memcpy(out, blockMagic, 4);
+    put16(out + 4, n);
+    put16(out + 6, samples[0].flags);
+    put64(out + 12, samples[0].timestamp);
+    int16_t prev[nChannels];
+    getChannels(samples[0], prev);
+    for (int i = 0; i < nChannels; i++) put16(out + 20 + 2 * i, (uint16_t)prev[i]);
+    out[38] = samples[0].scale;
+    out[39] = 0;
+    uint8_t prevScale = samples[0].scale;
+
+    uint8_t* p = out + blockHeaderSize;
+    uint64_t prevTimestamp = samples[0].timestamp;
+    int64_t prevInterval = 0;
+    for (unsigned j = 1; j < n; j++) {
+        const int64_t interval = (int64_t)(samples[j].timestamp - prevTimestamp);
+        p = putVarint(p, zigzag(interval - prevInterval));
+        p = putVarint(p, samples[j].flags | ((uint32_t)(samples[j].scale ^ prevScale) << 16));
+        prevScale = samples[j].scale;
+        prevInterval = interval;
+        prevTimestamp = samples[j].timestamp;
+        int16_t cur[nChannels];
+        getChannels(samples[j], cur);
+        for (int i = 0; i < nChannels; i++) {
+            p = putVarint(p, zigzag((int32_t)cur[i] - (int32_t)prev[i]));
+            prev[i] = cur[i];
+        }
+    }
+    const size_t payload = p - (out + blockHeaderSize);
+    put32(out + 8, (uint32_t)payload);
+    return blockHeaderSize + payload;
+}
+
+size_t LSM9DS1logCodec::blockSize(const uint8_t* in, size_t len)
+{
+    if (len < blockHeaderSize) return 0;
+    if (memcmp(in, blockMagic, 4) != 0) return 0;
+    const unsigned n = get16(in + 4);
+    if ((n == 0) || (n > maxBlockSamples)) return 0;
+    const size_t payload = get32(in + 8);
+    if (payload > maxEncodedSize(n) - blockHeaderSize) return 0;
+    return blockHeaderSize + payload;
+}
+
+unsigned LSM9DS1logCodec::decode(const uint8_t* in, size_t len, LSM9DS1sample* out)
+{
+    const size_t size = blockSize(in, len);
+    if ((size == 0) || (size > len)) return 0;
+    const unsigned n = get16(in + 4);
+
+    int16_t cur[nChannels];
+    for (int i = 0; i < nChannels; i++) cur[i] = (int16_t)get16(in + 20 + 2 * i);
+    out[0].timestamp = get64(in + 12);
+    out[0].flags = get16(in + 6);
+    out[0].scale = in[38];
+    setChannels(out[0], cur);
+
+    const uint8_t* p = in + blockHeaderSize;
+    const uint8_t* end = in + size;
+    int64_t interval = 0;
+    for (unsigned j = 1; j < n; j++) {
+        uint64_t v;
+        if (!(p = getVarint(p, end, v))) return 0;
+        interval += unzigzag(v);
+        out[j].timestamp = out[j - 1].timestamp + interval;
+        if (!(p = getVarint(p, end, v))) return 0;
+        out[j].flags = (uint16_t)v;
+        out[j].scale = out[j - 1].scale ^ (uint8_t)(v >> 16);
+        for (int i = 0; i < nChannels; i++) {
+            if (!(p = getVarint(p, end, v))) return 0;
+            cur[i] = (int16_t)(cur[i] + unzigzag(v));
+        }
+        setChannels(out[j], cur);
+    }
+    return n;
+}
+
+void LSM9DS1logCodec::writeHeader(const LSM9DS1logHeader& header, uint8_t* out)
+{
+    // [magic 4][version 2][gyro scale 2][accel scale][mag scale]
+    // [gyro rate][accel rate][mag rate][reserved 3]
+    memset(out, 0, fileHeaderSize);
+    memcpy(out, fileMagic, 4);
+    put16(out + 4, header.version);
+    put16(out + 6, header.gyroScale);
+    out[8] = header.accelScale;
+    out[9] = header.magScale;
+    out[10] = header.gyroSampleRate;
+    out[11] = header.accelSampleRate;
+    out[12] = header.magSampleRate;
+}
+
+bool LSM9DS1logCodec::parseHeader(const uint8_t* in, LSM9DS1logHeader& header)
+{
+    if (memcmp(in, fileMagic, 4) != 0) return false;
+    header.version = get16(in + 4);
+    if (header.version != LSM9DS1_LOG_VERSION) return false;
+    header.gyroScale = get16(in + 6);
+    header.accelScale = in[8];
+    header.magScale = in[9];
+    header.gyroSampleRate = in[10];
+    header.accelSampleRate = in[11];
+    header.magSampleRate = in[12];
+    return true;
+}
+
+void LSM9DS1logCodec::writeIndexHeader(uint8_t* out)
+{
+    // [magic 4][version 2][reserved 2]
+    memset(out, 0, indexHeaderSize);
+    memcpy(out, indexMagic, 4);
+    put16(out + 4, LSM9DS1_LOG_VERSION);
+}
+
+bool LSM9DS1logCodec::parseIndexHeader(const uint8_t* in)
+{
+    return (memcmp(in, indexMagic, 4) == 0) && (get16(in + 4) == LSM9DS1_LOG_VERSION);
+}
+
+void LSM9DS1logCodec::writeIndexEntry(uint64_t timestamp, uint64_t offset, uint8_t* out)
+{
+    put64(out, timestamp);
+    put64(out + 8, offset);
+}
+
+void LSM9DS1logCodec::parseIndexEntry(const uint8_t* in, uint64_t& timestamp, uint64_t& offset)
+{
+    timestamp = get64(in);
+    offset = get64(in + 8);
+}
+
+LSM9DS1logWriter::LSM9DS1logWriter(const char* filename, const IMUSettings& settings,
+                                   unsigned blockSamples, uint64_t indexInterval,
+                                   bool summaries)
+    : indexInterval(indexInterval)
+{
+    if (blockSamples < 1) blockSamples = 1;
+    if (blockSamples > LSM9DS1logCodec::maxBlockSamples)
+        blockSamples = LSM9DS1logCodec::maxBlockSamples;
+    this->blockSamples = blockSamples;
+
+    // All files first: nothing has been allocated yet if one fails
+    file = fopen(filename, "wb");
+    if (!file)
+        throw "Could not open log file for writing.";
+    // Fewer, larger writes are kinder to SD cards
+    setvbuf(file, NULL, _IOFBF, 64 * 1024);
+    if (indexInterval > 0) {
+        indexFile = fopen((std::string(filename) + ".idx").c_str(), "wb");
+        if (!indexFile) {
+            fclose(file);
+            throw "Could not open log index file for writing.";
+        }
+    }
+    if (summaries) {
+        try {
+            summary = new LSM9DS1summaryWriter(filename);
+        } catch (const char*) {
+            fclose(file);
+            if (indexFile) fclose(indexFile);
+            throw;
+        }
+    }
+
+    LSM9DS1logHeader header;
+    header.version = LSM9DS1_LOG_VERSION;
+    header.gyroScale = settings.gyro.scale;
+    header.accelScale = settings.accel.scale;
+    header.magScale = settings.mag.scale;
+    header.gyroSampleRate = settings.gyro.sampleRate;
+    header.accelSampleRate = settings.accel.sampleRate;
+    header.magSampleRate = settings.mag.sampleRate;
+    uint8_t h[LSM9DS1logCodec::fileHeaderSize];
+    LSM9DS1logCodec::writeHeader(header, h);
+    write(file, h, sizeof(h));
+    offset = sizeof(h);
+    if (indexFile) {
+        uint8_t ih[LSM9DS1logCodec::indexHeaderSize];
+        LSM9DS1logCodec::writeIndexHeader(ih);
+        write(indexFile, ih, sizeof(ih));
+    }
+    if (writeError) {
+        fclose(file);
+        if (indexFile) fclose(indexFile);
+        delete summary;
+        throw "Could not write log file.";
+    }
+
+    pending = new LSM9DS1sample[blockSamples];
+    encoded = new uint8_t[LSM9DS1logCodec::maxEncodedSize(blockSamples)];
+}
+
+LSM9DS1logWriter::~LSM9DS1logWriter()
+{
+    flush();
+    if ((fclose(file) != 0) && !writeError) failed();
+    if (indexFile) fclose(indexFile);
+    delete summary;
+    delete[] pending;
+    delete[] encoded;
+}
+
+void LSM9DS1logWriter::hasSample(const LSM9DS1sample& sample)
+{
+    if (summary) summary->hasSample(sample);
+    pending[nPending++] = sample;
+    if (nPending == blockSamples) writeBlock();
+}
+
+void LSM9DS1logWriter::blockEnd()
+{
+    writeBlock();
+}
+
+void LSM9DS1logWriter::flush()
+{
+    writeBlock();
+    if ((fflush(file) != 0) && !writeError) failed();
+    if (indexFile) fflush(indexFile);
+    if (summary) summary->flush();
+}
+
+void LSM9DS1logWriter::writeBlock()
+{
+    if (nPending == 0) return;
+    if (indexFile && (pending[0].timestamp >= nextIndexTimestamp)) {
+        uint8_t entry[LSM9DS1logCodec::indexEntrySize];
+        LSM9DS1logCodec::writeIndexEntry(pending[0].timestamp, offset, entry);
+        write(indexFile, entry, sizeof(entry));
+        nextIndexTimestamp = pending[0].timestamp + indexInterval;
+    }
+    const size_t n = LSM9DS1logCodec::encode(pending, nPending, encoded);
+    write(file, encoded, n);
+    offset += n;
+    nPending = 0;
+}
+
+void LSM9DS1logWriter::write(FILE* f, const uint8_t* data, size_t n)
+{
+    // After a failure the file may end in a torn block: leave it at that
+    if (writeError) return;
+    if (fwrite(data, 1, n, f) != n) failed();
+}
+
+void LSM9DS1logWriter::failed()
+{
+    writeError = errno ? errno : EIO;
+    fprintf(stderr, "Error: writing the log failed: %s\n", strerror(writeError));
+}
+
+LSM9DS1logReader::LSM9DS1logReader(const char* filename)
+{
+    file = fopen(filename, "rb");
+    if (!file)
+        throw "Could not open log file for reading.";
+    uint8_t h[LSM9DS1logCodec::fileHeaderSize];
+    if ((fread(h, 1, sizeof(h), file) != sizeof(h)) ||
+        (!LSM9DS1logCodec::parseHeader(h, header))) {
+        fclose(file);
+        throw "Not an LSM9DS1 log file.";
+    }
+    block = new LSM9DS1sample[LSM9DS1logCodec::maxBlockSamples];
+    encoded = new uint8_t[LSM9DS1logCodec::maxEncodedSize(LSM9DS1logCodec::maxBlockSamples)];
+}
+
+LSM9DS1logReader::~LSM9DS1logReader()
+{
+    fclose(file);
+    delete[] block;
+    delete[] encoded;
+}
+
+bool LSM9DS1logReader::readBlock()
+{
+    const size_t hs = LSM9DS1logCodec::blockHeaderSize;
+    if (fread(encoded, 1, hs, file) != hs) return false;
+    const size_t size = LSM9DS1logCodec::blockSize(encoded, hs);
+    if (size == 0) return false;
+    if (fread(encoded + hs, 1, size - hs, file) != size - hs) return false;
+    nBlock = LSM9DS1logCodec::decode(encoded, size, block);
+    pos = 0;
+    return nBlock > 0;
+}
+
+bool LSM9DS1logReader::next(LSM9DS1sample& sample)
+{
+    if (pos >= nBlock) {
+        if (!readBlock()) return false;
+    }
+    sample = block[pos++];
+    return true;
+}
+
+const LSM9DS1sample* LSM9DS1logReader::pull()
+{
+    if (pos >= nBlock) {
+        if (!readBlock()) return NULL;
+    }
+    return &block[pos++];
+}
+
+void LSM9DS1logReader::rewind()
+{
+    fseek(file, LSM9DS1logCodec::fileHeaderSize, SEEK_SET);
+    nBlock = 0;
+    pos = 0;
+}
@@ -0,0 +1,190 @@
+/******************************************************************************
+LSM9DS1_Log.h
+Compact on-disk record format for raw LSM9DS1 samples.
+
+A log file is a file header followed by self-contained blocks. Each block
+stores its first sample verbatim and every following sample as per-channel
+differences to its predecessor, zigzag mapped and written as varints. The
+timestamp is stored as the change of the sampling interval so that a
+steady ODR costs a single byte, and so are the sample flags together with
+any change of the full scales. A 9-axis sample at rest typically shrinks
+from 26 to 10-12 bytes.
+
+Blocks are closed either after a fixed number of samples or whenever the
+acquisition signals the end of a FIFO drain, so that a block never
+straddles two bus transactions and a torn write loses at most one block.
+
+Next to each log the writer keeps a sparse time index "<log>.idx" with
+one entry per second of recording (see LSM9DS1_LogIndex.h) and a pyramid
+of min/max/mean summaries "<log>.sum<seconds>" (see LSM9DS1_Summary.h).
+
+All multi-byte values are stored little endian.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Log_H__
+#define __LSM9DS1_Log_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "LSM9DS1_Types.h"
+#include "LSM9DS1_Sample.h"
+#include "LSM9DS1_Range.h"
+#include "LSM9DS1_Summary.h"
+
+#define LSM9DS1_LOG_VERSION 3
+
+// Describes the recording. Stored once at the start of every log file.
+// The scales are the ones at the start; each sample carries its own.
+struct LSM9DS1logHeader
+{
+	uint16_t version;
+	uint16_t gyroScale;	// 245, 500 or 2000 dps
+	uint8_t accelScale;	// 2, 4, 8 or 16 g
+	uint8_t magScale;	// 4, 8, 12 or 16 Gs
+	uint8_t gyroSampleRate;	// as in gyroSettings
+	uint8_t accelSampleRate;	// as in accelSettings
+	uint8_t magSampleRate;	// as in magSettings
+};
+
+class LSM9DS1logCodec {
+public:
+	// Size of the fixed part of a block on disk.
+	static const size_t blockHeaderSize = 40;
+	// Size of the file header on disk.
+	static const size_t fileHeaderSize = 16;
+	// Upper limit of samples in one block.
+	static const unsigned maxBlockSamples = 1024;
+	// Size of the index file header and of one index entry on disk.
+	static const size_t indexHeaderSize = 8;
+	static const size_t indexEntrySize = 16;
+
+	// maxEncodedSize() -- Worst case size of a block of n samples.
+	// Use it to size the buffer handed to encode().
+	static size_t maxEncodedSize(unsigned n);
+
+	// encode() -- Encodes n samples (1..maxBlockSamples) into one block.
+	// Input:
+	//    - samples = the samples in acquisition order
+	//    - n = number of samples
+	//    - out = buffer of at least maxEncodedSize(n) bytes
+	// Output: number of bytes written to out.
+	static size_t encode(const LSM9DS1sample* samples, unsigned n, uint8_t* out);
+
+	// blockSize() -- Total size of the block starting at in, read from its
+	// fixed header. Returns 0 if in does not point to a valid block header.
+	static size_t blockSize(const uint8_t* in, size_t len);
+
+	// decode() -- Decodes one block.
+	// Input:
+	//    - in = start of the block
+	//    - len = bytes available at in
+	//    - out = room for maxBlockSamples samples
+	// Output: number of samples decoded or 0 if the block is corrupt.
+	static unsigned decode(const uint8_t* in, size_t len, LSM9DS1sample* out);
+
+	// Serialise / parse the file header. parseHeader() returns false
+	// if the magic or the version does not match.
+	static void writeHeader(const LSM9DS1logHeader& header, uint8_t* out);
+	static bool parseHeader(const uint8_t* in, LSM9DS1logHeader& header);
+
+	// Serialise / parse the index file header and its entries: the
+	// timestamp of the first sample of a block and the block's file offset.
+	static void writeIndexHeader(uint8_t* out);
+	static bool parseIndexHeader(const uint8_t* in);
+	static void writeIndexEntry(uint64_t timestamp, uint64_t offset, uint8_t* out);
+	static void parseIndexEntry(const uint8_t* in, uint64_t& timestamp, uint64_t& offset);
+};
+
+// Sink which writes the sample stream into a log file.
+class LSM9DS1logWriter : public LSM9DS1sampleSink {
+public:
+	// Opens the log file and writes its header. Throws if a file can't be
+	// created or written.
+	// Input:
+	//    - filename = the log file which is created or truncated
+	//    - settings = the settings of the recorded device (scales and rates)
+	//    - blockSamples = number of samples after which a block is closed
+	//      even if no FIFO drain has ended it. The default matches the
+	//      depth of the FIFO.
+	//    - indexInterval = minimum time in ns between two entries of the
+	//      time index. 0 disables the index file.
+	//    - summaries = maintain the summary pyramid next to the log
+	LSM9DS1logWriter(const char* filename, const IMUSettings& settings,
+			 unsigned blockSamples = 32,
+			 uint64_t indexInterval = 1000000000,
+			 bool summaries = true);
+	~LSM9DS1logWriter();
+
+	virtual void hasSample(const LSM9DS1sample& sample);
+	virtual void blockEnd();
+
+	// Writes the pending samples as a block and flushes the file.
+	void flush();
+
+	// getWriteError() -- 0 or the errno of the first write which failed,
+	// for example ENOSPC on a full card. The writer stops writing then:
+	// the log ends with the last block written completely.
+	int getWriteError() const {
+		return writeError;
+	}
+
+protected:
+	FILE* file;
+	FILE* indexFile = NULL;
+	std::atomic<int> writeError{0};
+	LSM9DS1summaryWriter* summary = NULL;
+	uint64_t indexInterval;
+	uint64_t nextIndexTimestamp = 0;
+	uint64_t offset = 0;
+	unsigned blockSamples;
+	unsigned nPending = 0;
+	LSM9DS1sample* pending;
+	uint8_t* encoded;
+	void writeBlock();
+	// write() -- fwrite() which records a failure in writeError.
+	void write(FILE* f, const uint8_t* data, size_t n);
+	void failed();
+};
+
+// Reads a log file sample by sample, also as a range of samples.
+class LSM9DS1logReader : public LSM9DS1sampleStream {
+public:
+	LSM9DS1logReader(const char* filename);
+	~LSM9DS1logReader();
+
+	const LSM9DS1logHeader& getHeader() const {
+		return header;
+	}
+
+	// next() -- Fetches the next sample.
+	// Output: false at the end of the log or at a torn final block.
+	bool next(LSM9DS1sample& sample);
+
+	// pull() -- The next sample in place in the decoded block, see
+	// LSM9DS1_Range.h. NULL at the end of the log.
+	virtual const LSM9DS1sample* pull();
+
+	// atBlockEnd() -- True if the sample returned last by next() was the
+	// last one of its block, i.e. the end of a FIFO drain when recorded.
+	bool atBlockEnd() const {
+		return pos >= nBlock;
+	}
+
+	// Goes back to the first sample.
+	void rewind();
+
+protected:
+	FILE* file;
+	LSM9DS1logHeader header;
+	LSM9DS1sample* block;
+	uint8_t* encoded;
+	unsigned nBlock = 0;
+	unsigned pos = 0;
+	bool readBlock();
+};
+
+#endif
@@ -0,0 +1,146 @@
+/******************************************************************************
+LSM9DS1_LogIndex.cpp
+Time index lookup and memory mapped windows of LSM9DS1 logs.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <algorithm>
+#include "LSM9DS1_LogIndex.h"
+
+LSM9DS1logIndex::LSM9DS1logIndex(const char* logFilename)
+{
+    FILE* f = fopen((std::string(logFilename) + ".idx").c_str(), "rb");
+    if (!f)
+        throw "Could not open log index file.";
+    uint8_t buf[LSM9DS1logCodec::indexEntrySize];
+    if ((fread(buf, 1, LSM9DS1logCodec::indexHeaderSize, f) != LSM9DS1logCodec::indexHeaderSize) ||
+        (!LSM9DS1logCodec::parseIndexHeader(buf))) {
+        fclose(f);
+        throw "Not an LSM9DS1 log index file.";
+    }
+    LSM9DS1logIndexEntry entry;
+    while (fread(buf, 1, sizeof(buf), f) == sizeof(buf)) {
+        LSM9DS1logCodec::parseIndexEntry(buf, entry.timestamp, entry.offset);
+        entries.push_back(entry);
+    }
+    fclose(f);
+}
+
+static bool entryBefore(uint64_t t, const LSM9DS1logIndexEntry& e)
+{
+    return t < e.timestamp;
+}
+
+uint64_t LSM9DS1logIndex::lowerOffset(uint64_t t) const
+{
+    std::vector<LSM9DS1logIndexEntry>::const_iterator it =
+        std::upper_bound(entries.begin(), entries.end(), t, entryBefore);
+    if (it == entries.begin()) return LSM9DS1logCodec::fileHeaderSize;
+    return (it - 1)->offset;
+}
+
+uint64_t LSM9DS1logIndex::upperOffset(uint64_t t) const
+{
+    std::vector<LSM9DS1logIndexEntry>::const_iterator it =
+        std::upper_bound(entries.begin(), entries.end(), t, entryBefore);
+    if (it == entries.end()) return 0;
+    return it->offset;
+}
+
+LSM9DS1logWindow::LSM9DS1logWindow(const char* logFilename, uint64_t from, uint64_t to)
+    : from(from), to(to)
+{
+    const int fd = open(logFilename, O_RDONLY);
+    if (fd < 0)
+        throw "Could not open log file for reading.";
+    struct stat st;
+    uint8_t h[LSM9DS1logCodec::fileHeaderSize];
+    if ((fstat(fd, &st) < 0) ||
+        (pread(fd, h, sizeof(h), 0) != (ssize_t)sizeof(h)) ||
+        (!LSM9DS1logCodec::parseHeader(h, header))) {
+        close(fd);
+        throw "Not an LSM9DS1 log file.";
+    }
+
+    uint64_t lower = LSM9DS1logCodec::fileHeaderSize;
+    uint64_t upper = st.st_size;
+    try {
+        LSM9DS1logIndex index(logFilename);
+        lower = index.lowerOffset(from);
+        const uint64_t u = index.upperOffset(to);
+        if (u) upper = u;
+    } catch (const char*) {
+        // no index: scan the whole log
+    }
+
+    block = new LSM9DS1sample[LSM9DS1logCodec::maxBlockSamples];
+    if (upper <= lower) {
+        close(fd);
+        done = true;
+        return;
+    }
+
+    // mmap needs a page aligned offset
+    const uint64_t page = sysconf(_SC_PAGESIZE);
+    const uint64_t aligned = lower - (lower % page);
+    mapSize = upper - aligned;
+    map = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, aligned);
+    close(fd);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        delete[] block;
+        throw "Could not map log file.";
+    }
+    madvise(map, mapSize, MADV_SEQUENTIAL);
+    cursor = (const uint8_t*)map + (lower - aligned);
+    mapEnd = (const uint8_t*)map + mapSize;
+}
+
+LSM9DS1logWindow::~LSM9DS1logWindow()
+{
+    if (map) munmap(map, mapSize);
+    delete[] block;
+}
+
+bool LSM9DS1logWindow::next(LSM9DS1sample& sample)
+{
+    const LSM9DS1sample* s = pull();
+    if (!s) return false;
+    sample = *s;
+    return true;
+}
+
+const LSM9DS1sample* LSM9DS1logWindow::pull()
+{
+    while (!done) {
+        if (pos >= nBlock) {
+            const size_t size = LSM9DS1logCodec::blockSize(cursor, mapEnd - cursor);
+            if (size == 0) {
+                done = true;
+                break;
+            }
+            nBlock = LSM9DS1logCodec::decode(cursor, mapEnd - cursor, block);
+            if (nBlock == 0) {
+                done = true;
+                break;
+            }
+            cursor += size;
+            pos = 0;
+        }
+        const LSM9DS1sample* s = &block[pos++];
+        if (s->timestamp < from) continue;
+        if (s->timestamp > to) {
+            done = true;
+            break;
+        }
+        return s;
+    }
+    return NULL;
+}
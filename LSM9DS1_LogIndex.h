@@ -0,0 +1,88 @@
+/******************************************************************************
+LSM9DS1_LogIndex.h
+Random access into LSM9DS1 logs by time.
+
+LSM9DS1logWriter keeps a sparse index "<log>.idx" next to every log which
+maps the timestamp of the first sample of a block to the block's offset in
+the log file. LSM9DS1logIndex binary-searches it and LSM9DS1logWindow maps
+just the blocks which cover a requested time range, so that reading ten
+seconds out of a day-long recording touches a few hundred kilobytes.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_LogIndex_H__
+#define __LSM9DS1_LogIndex_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "LSM9DS1_Log.h"
+
+struct LSM9DS1logIndexEntry
+{
+	uint64_t timestamp;	// first sample of the block
+	uint64_t offset;	// of the block in the log file
+};
+
+class LSM9DS1logIndex {
+public:
+	// Loads the index of the log. Throws if it's missing or invalid.
+	LSM9DS1logIndex(const char* logFilename);
+
+	// lowerOffset() -- Offset of the last indexed block which starts at or
+	// before t. Reading from there returns every sample at or after t.
+	uint64_t lowerOffset(uint64_t t) const;
+
+	// upperOffset() -- Offset of the first indexed block which starts after
+	// t or 0 if there is none. Every sample up to t is before it.
+	uint64_t upperOffset(uint64_t t) const;
+
+	const std::vector<LSM9DS1logIndexEntry>& getEntries() const {
+		return entries;
+	}
+
+protected:
+	std::vector<LSM9DS1logIndexEntry> entries;
+};
+
+// The samples of a log between two timestamps, read from a memory mapping
+// of only the blocks covering them. A range of samples (LSM9DS1_Range.h).
+class LSM9DS1logWindow : public LSM9DS1sampleStream {
+public:
+	// Maps the part of the log which covers [from, to] (timestamps in ns).
+	// Without an index file the whole log is mapped.
+	LSM9DS1logWindow(const char* logFilename, uint64_t from, uint64_t to);
+	~LSM9DS1logWindow();
+
+	const LSM9DS1logHeader& getHeader() const {
+		return header;
+	}
+
+	// next() -- Fetches the next sample within [from, to].
+	// Output: false once the window has been read.
+	bool next(LSM9DS1sample& sample);
+
+	// pull() -- The next sample within [from, to] in place in the decoded
+	// block, see LSM9DS1_Range.h. NULL once the window has been read.
+	virtual const LSM9DS1sample* pull();
+
+	// Number of bytes of the log which are mapped.
+	size_t mappedSize() const {
+		return mapSize;
+	}
+
+protected:
+	LSM9DS1logHeader header;
+	uint64_t from, to;
+	void* map = NULL;
+	size_t mapSize = 0;
+	const uint8_t* cursor = NULL;
+	const uint8_t* mapEnd = NULL;
+	LSM9DS1sample* block;
+	unsigned nBlock = 0;
+	unsigned pos = 0;
+	bool done = false;
+};
+
+#endif
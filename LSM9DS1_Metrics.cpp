@@ -0,0 +1,206 @@
+/******************************************************************************
+LSM9DS1_Metrics.cpp
+Metrics registry, Prometheus text exposition and its Unix socket server.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <new>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "LSM9DS1_Metrics.h"
+
+#define LSM9DS1_METRICS_VERSION 1
+
+struct MetricsHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t capacity;
+	std::atomic<uint32_t> count;
+	uint8_t reserved[48];
+};
+
+static const size_t headerSize = 64;
+
+static_assert(sizeof(MetricsHeader) == headerSize, "metrics header layout");
+static_assert(sizeof(LSM9DS1metric) == 128, "metrics entry layout");
+
+LSM9DS1metrics::LSM9DS1metrics(const char* shmName, unsigned capacity)
+    : capacity(capacity), serving(false)
+{
+    size = headerSize + capacity * sizeof(LSM9DS1metric);
+    if (shmName) {
+        this->shmName = shmName;
+        const int fd = shm_open(shmName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) throw "Could not create the metrics shared memory.";
+        if (ftruncate(fd, size) < 0) {
+            close(fd);
+            shm_unlink(shmName);
+            throw "Could not size the metrics shared memory.";
+        }
+        void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            shm_unlink(shmName);
+            throw "Could not map the metrics shared memory.";
+        }
+        page = (uint8_t*)p;
+    } else {
+        page = (uint8_t*)mmap(NULL, size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (page == MAP_FAILED) throw "Could not allocate the metrics.";
+    }
+    memset(page, 0, size);
+    MetricsHeader* header = new (page) MetricsHeader;
+    memcpy(header->magic, "LSMM", 4);
+    header->version = LSM9DS1_METRICS_VERSION;
+    header->capacity = capacity;
+    header->count.store(0, std::memory_order_relaxed);
+    entries = (LSM9DS1metric*)(page + headerSize);
+}
+
+LSM9DS1metrics::~LSM9DS1metrics()
+{
+    if (serving) {
+        serving = false;
+        serverThread.join();
+        close(listenFd);
+        unlink(socketPath.c_str());
+    }
+    munmap(page, size);
+    if (!shmName.empty()) shm_unlink(shmName.c_str());
+}
+
+unsigned LSM9DS1metrics::getCount() const
+{
+    return ((const MetricsHeader*)page)->count.load(std::memory_order_acquire);
+}
+
+LSM9DS1metric& LSM9DS1metrics::add(const char* name, const char* help, const char* labels,
+                                   double scale, uint32_t type)
+{
+    std::string series = name;
+    if (labels && *labels) series = series + "{" + labels + "}";
+    if (series.size() >= sizeof(entries[0].name)) throw "Metric name too long.";
+
+    std::lock_guard<std::mutex> lock(registerMutex);
+    MetricsHeader* header = (MetricsHeader*)page;
+    const unsigned n = header->count.load(std::memory_order_relaxed);
+    for (unsigned i = 0; i < n; i++)
+        if (series == entries[i].name) return entries[i];
+    if (n >= capacity) throw "Too many metrics.";
+
+    LSM9DS1metric* m = new (&entries[n]) LSM9DS1metric;
+    strcpy(m->name, series.c_str());
+    m->type = type;
+    m->reserved = 0;
+    m->scale = scale;
+    m->value.store(0, std::memory_order_relaxed);
+    bool known = false;
+    for (size_t f = 0; f < families.size(); f++)
+        if (families[f].name == name) known = true;
+    if (!known) families.push_back({name, help ? help : "", type});
+    // Publish the entry to readers of the shared memory
+    header->count.store(n + 1, std::memory_order_release);
+    return *m;
+}
+
+LSM9DS1metric& LSM9DS1metrics::counter(const char* name, const char* help,
+                                       const char* labels, double scale)
+{
+    return add(name, help, labels, scale, METRIC_COUNTER);
+}
+
+LSM9DS1metric& LSM9DS1metrics::gauge(const char* name, const char* help,
+                                     const char* labels, double scale)
+{
+    return add(name, help, labels, scale, METRIC_GAUGE);
+}
+
+std::string LSM9DS1metrics::prometheus() const
+{
+    std::lock_guard<std::mutex> lock(registerMutex);
+    const unsigned n = getCount();
+    std::string text;
+    char line[160];
+    // All series of a family have to follow its HELP and TYPE lines
+    for (size_t f = 0; f < families.size(); f++) {
+        const Family& family = families[f];
+        text += "# HELP " + family.name + " " + family.help + "\n";
+        text += "# TYPE " + family.name +
+            (family.type == METRIC_COUNTER ? " counter\n" : " gauge\n");
+        for (unsigned i = 0; i < n; i++) {
+            const LSM9DS1metric& m = entries[i];
+            const size_t len = family.name.size();
+            if ((strncmp(m.name, family.name.c_str(), len) != 0) ||
+                ((m.name[len] != 0) && (m.name[len] != '{')))
+                continue;
+            if (m.scale == 1)
+                snprintf(line, sizeof(line), "%s %lld\n", m.name, (long long)m.get());
+            else
+                snprintf(line, sizeof(line), "%s %.9g\n", m.name, m.get() * m.scale);
+            text += line;
+        }
+    }
+    return text;
+}
+
+void LSM9DS1metrics::writePrometheus(const char* filename) const
+{
+    const std::string text = prometheus();
+    const std::string tmp = std::string(filename) + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) throw "Could not write the metrics file.";
+    const bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+    if ((fclose(f) != 0) || !ok || (rename(tmp.c_str(), filename) != 0)) {
+        unlink(tmp.c_str());
+        throw "Could not write the metrics file.";
+    }
+}
+
+void LSM9DS1metrics::serve(const char* socketPath)
+{
+    if (serving) return;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) throw "Socket path too long.";
+    strcpy(addr.sun_path, socketPath);
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) throw "Could not create the metrics socket.";
+    unlink(socketPath);
+    if ((bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0) ||
+        (listen(listenFd, 4) < 0)) {
+        close(listenFd);
+        throw "Could not listen on the metrics socket.";
+    }
+    this->socketPath = socketPath;
+    serving = true;
+    serverThread = std::thread(&LSM9DS1metrics::serveLoop, this);
+}
+
+void LSM9DS1metrics::serveLoop()
+{
+    while (serving) {
+        struct pollfd pfd = {listenFd, POLLIN, 0};
+        // Look at the flag every 100 ms
+        if (poll(&pfd, 1, 100) <= 0) continue;
+        const int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0) continue;
+        const std::string text = prometheus();
+        size_t done = 0;
+        while (done < text.size()) {
+            const ssize_t r = send(fd, text.data() + done, text.size() - done, MSG_NOSIGNAL);
+            if (r <= 0) break;
+            done += r;
+        }
+        close(fd);
+    }
+}
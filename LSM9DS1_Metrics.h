@@ -0,0 +1,131 @@
+/******************************************************************************
+LSM9DS1_Metrics.h
+Counters and gauges for monitoring, exported as Prometheus text and
+through a shared-memory page.
+
+The registry holds a fixed number of metrics in one block of memory
+allocated up front. Updating a metric is a single relaxed atomic
+operation, so it can be done in the timer's signal handler. The block is
+either private to the process or a POSIX shared-memory object which
+other processes map read-only and poll without any call into this one.
+
+Layout of the shared memory (all little endian on the Pi):
+    header, 64 bytes:  [magic "LSMM" 4][version 4][capacity 4][count 4][reserved 48]
+    entry, 128 bytes:  [series name, NUL terminated 104][type 4][reserved 4]
+                       [scale, double 8][value, int64 8]
+The series name includes the labels, e.g. lsm9ds1_samples_total{device="imu"}.
+The exported value is value * scale. Entries never move once registered
+and count only grows.
+
+The Prometheus text can be requested at any time as a string, written
+to a file (for the node_exporter textfile collector) or served on a Unix
+socket: every connection gets the current text and is closed.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Metrics_H__
+#define __LSM9DS1_Metrics_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+
+enum metric_type
+{
+	METRIC_COUNTER = 0,
+	METRIC_GAUGE = 1,
+};
+
+// One counter or gauge. Handed out by LSM9DS1metrics, lives as long as it.
+class LSM9DS1metric {
+public:
+	// inc() -- Adds to a counter or gauge.
+	void inc(int64_t n = 1) {
+		value.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	// set() -- Sets a gauge.
+	void set(int64_t v) {
+		value.store(v, std::memory_order_relaxed);
+	}
+
+	int64_t get() const {
+		return value.load(std::memory_order_relaxed);
+	}
+
+protected:
+	friend class LSM9DS1metrics;
+	char name[104];
+	uint32_t type;
+	uint32_t reserved;
+	double scale;
+	std::atomic<int64_t> value;
+};
+
+class LSM9DS1metrics {
+public:
+	// Allocates room for the metrics.
+	// Input:
+	//    - shmName = name of the shared-memory object ("/lsm9ds1") or
+	//      NULL to keep the metrics private to the process
+	//    - capacity = maximum number of metrics. The default fills one page.
+	LSM9DS1metrics(const char* shmName = NULL, unsigned capacity = 31);
+	// Stops serving and unlinks the shared-memory object.
+	~LSM9DS1metrics();
+
+	// counter() / gauge() -- Registers a metric. Not to be called from
+	// the acquisition context. Registering a series twice returns the
+	// first one.
+	// Input:
+	//    - name = metric name, e.g. "lsm9ds1_samples_total"
+	//    - help = one line description for the HELP comment
+	//    - labels = Prometheus labels without braces, e.g. "device=\"imu\""
+	//    - scale = factor from the stored integer to the exported value,
+	//      e.g. 1e-9 to export ns as seconds
+	// Output: the metric, throws if the registry is full.
+	LSM9DS1metric& counter(const char* name, const char* help,
+			       const char* labels = "", double scale = 1);
+	LSM9DS1metric& gauge(const char* name, const char* help,
+			     const char* labels = "", double scale = 1);
+
+	// prometheus() -- The current values in the Prometheus text format.
+	std::string prometheus() const;
+
+	// writePrometheus() -- Writes prometheus() into a file. The file is
+	// replaced atomically so that readers never see half of it.
+	void writePrometheus(const char* filename) const;
+
+	// serve() -- Answers every connection to a Unix socket with
+	// prometheus() from a thread of its own.
+	void serve(const char* socketPath);
+
+	// Number of metrics registered.
+	unsigned getCount() const;
+
+protected:
+	struct Family {
+		std::string name;
+		std::string help;
+		uint32_t type;
+	};
+	std::string shmName;
+	size_t size;
+	unsigned capacity;
+	uint8_t* page;
+	LSM9DS1metric* entries;
+	std::vector<Family> families;
+	mutable std::mutex registerMutex;
+	std::string socketPath;
+	int listenFd = -1;
+	std::atomic<bool> serving;
+	std::thread serverThread;
+	LSM9DS1metric& add(const char* name, const char* help, const char* labels,
+			   double scale, uint32_t type);
+	void serveLoop();
+};
+
+#endif
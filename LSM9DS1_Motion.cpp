@@ -0,0 +1,196 @@
+/******************************************************************************
+LSM9DS1_Motion.cpp
+Motion profiles and the body frame quantities they produce.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <math.h>
+#include <string.h>
+#include "LSM9DS1_Motion.h"
+
+// Quaternions {w, x, y, z}
+static void multiply(const double p[4], const double q[4], double r[4])
+{
+    const double w = p[0] * q[0] - p[1] * q[1] - p[2] * q[2] - p[3] * q[3];
+    const double x = p[0] * q[1] + p[1] * q[0] + p[2] * q[3] - p[3] * q[2];
+    const double y = p[0] * q[2] - p[1] * q[3] + p[2] * q[0] + p[3] * q[1];
+    const double z = p[0] * q[3] + p[1] * q[2] - p[2] * q[1] + p[3] * q[0];
+    r[0] = w; r[1] = x; r[2] = y; r[3] = z;
+}
+
+// World vector v into body coordinates: conj(q) v q
+static void toBody(const double q[4], const float v[3], float b[3])
+{
+    const double qc[4] = {q[0], -q[1], -q[2], -q[3]};
+    const double p[4] = {0, v[0], v[1], v[2]};
+    double t[4], r[4];
+    multiply(qc, p, t);
+    multiply(t, q, r);
+    b[0] = (float)r[1]; b[1] = (float)r[2]; b[2] = (float)r[3];
+}
+
+static void normalise(const float in[3], float out[3])
+{
+    const float l = sqrtf(in[0] * in[0] + in[1] * in[1] + in[2] * in[2]);
+    for (int i = 0; i < 3; i++) out[i] = l > 0 ? in[i] / l : 0;
+}
+
+// Orientation after turning at rate (rad/s) about the body axis for dt s
+static void turn(const double q0[4], const float axis[3], double rate, double dt, double q[4])
+{
+    const double half = 0.5 * rate * dt;
+    const double s = sin(half);
+    const double d[4] = {cos(half), axis[0] * s, axis[1] * s, axis[2] * s};
+    multiply(q0, d, q);
+}
+
+LSM9DS1motionSimulator::LSM9DS1motionSimulator(uint8_t xgAddr, uint8_t mAddr)
+    : LSM9DS1simulator(xgAddr, mAddr)
+{
+}
+
+void LSM9DS1motionSimulator::add(Segment& segment, double seconds)
+{
+    segment.start = duration;
+    segment.length = seconds > 0 ? (uint64_t)(seconds * 1e9) : 0;
+    // Where the previous segment left the body
+    if (segments.empty()) {
+        segment.q0[0] = 1;
+        segment.q0[1] = segment.q0[2] = segment.q0[3] = 0;
+    } else {
+        const Segment& last = segments.back();
+        if (last.type == MOTION_ROTATION) {
+            turn(last.q0, last.axis, last.rate, last.length / 1e9, segment.q0);
+        } else {
+            memcpy(segment.q0, last.q0, sizeof(segment.q0));
+        }
+    }
+    segments.push_back(segment);
+    duration += segment.length;
+}
+
+void LSM9DS1motionSimulator::addStatic(double seconds)
+{
+    Segment s = Segment();
+    s.type = MOTION_STATIC;
+    add(s, seconds);
+}
+
+void LSM9DS1motionSimulator::addRotation(double seconds, const float axis[3], float dps)
+{
+    Segment s = Segment();
+    s.type = MOTION_ROTATION;
+    normalise(axis, s.axis);
+    s.rate = dps * (float)M_PI / 180.0f;
+    add(s, seconds);
+}
+
+void LSM9DS1motionSimulator::addVibration(double seconds, const float axis[3],
+                                          const float* hz, const float* amplitude, unsigned n)
+{
+    Segment s = Segment();
+    s.type = MOTION_VIBRATION;
+    normalise(axis, s.axis);
+    if (n > maxFrequencies) n = maxFrequencies;
+    for (unsigned i = 0; i < n; i++) {
+        s.hz[i] = hz[i];
+        s.amplitude[i] = amplitude[i];
+    }
+    s.n = n;
+    add(s, seconds);
+}
+
+void LSM9DS1motionSimulator::addShock(double seconds, const float axis[3], float peak,
+                                      double pulseSeconds)
+{
+    Segment s = Segment();
+    s.type = MOTION_SHOCK;
+    normalise(axis, s.axis);
+    s.amplitude[0] = peak;
+    s.pulse = pulseSeconds;
+    add(s, seconds);
+}
+
+void LSM9DS1motionSimulator::addFreeFall(double seconds)
+{
+    Segment s = Segment();
+    s.type = MOTION_FREEFALL;
+    add(s, seconds);
+}
+
+void LSM9DS1motionSimulator::clearProfile()
+{
+    segments.clear();
+    duration = 0;
+}
+
+void LSM9DS1motionSimulator::startProfile()
+{
+    profileStart = now();
+    started = true;
+}
+
+void LSM9DS1motionSimulator::truth(uint64_t t, float q[4], float g[3],
+                                   float a[3], float m[3]) const
+{
+    double o[4] = {1, 0, 0, 0};
+    float rate[3] = {0, 0, 0};
+    float linear[3] = {0, 0, 0};	// world acceleration in g
+    bool falling = false;
+    if (started && (t >= profileStart) && !segments.empty()) {
+        const uint64_t p = t - profileStart;
+        // The segment at p, the last one after the end
+        size_t i = 0;
+        while ((i + 1 < segments.size()) && (segments[i + 1].start <= p)) i++;
+        const Segment& s = segments[i];
+        const bool within = p < s.start + s.length;
+        const double dt = (within ? p - s.start : s.length) / 1e9;
+        memcpy(o, s.q0, sizeof(o));
+        switch (s.type) {
+        case MOTION_ROTATION:
+            turn(s.q0, s.axis, s.rate, dt, o);
+            if (within) {
+                for (int k = 0; k < 3; k++) rate[k] = s.axis[k] * s.rate * 180.0f / (float)M_PI;
+            }
+            break;
+        case MOTION_VIBRATION:
+            if (within) {
+                double v = 0;
+                for (unsigned k = 0; k < s.n; k++)
+                    v += s.amplitude[k] * sin(2 * M_PI * s.hz[k] * dt);
+                for (int k = 0; k < 3; k++) linear[k] = (float)(s.axis[k] * v);
+            }
+            break;
+        case MOTION_SHOCK:
+            if (within && (dt < s.pulse)) {
+                const double v = s.amplitude[0] * sin(M_PI * dt / s.pulse);
+                for (int k = 0; k < 3; k++) linear[k] = (float)(s.axis[k] * v);
+            }
+            break;
+        case MOTION_FREEFALL:
+            falling = within;
+            break;
+        default:
+            break;
+        }
+    }
+    for (int k = 0; k < 4; k++) q[k] = (float)o[k];
+    if (g) {
+        for (int k = 0; k < 3; k++) g[k] = restG[k] + rate[k];
+    }
+    if (a) {
+        // Specific force: the reaction to gravity plus the linear
+        // acceleration, nothing while falling
+        float f[3];
+        for (int k = 0; k < 3; k++) f[k] = falling ? 0 : restA[k] + linear[k];
+        toBody(o, f, a);
+    }
+    if (m) toBody(o, restM, m);
+}
+
+void LSM9DS1motionSimulator::physical(uint64_t t, float g[3], float a[3], float m[3])
+{
+    float q[4];
+    truth(t, q, g, a, m);
+}
@@ -0,0 +1,114 @@
+/******************************************************************************
+LSM9DS1_Motion.h
+Simulated LSM9DS1 moved along a scripted motion profile.
+
+The profile is a sequence of segments: lying still, rotating about a
+body axis, vibrating, a shock and free fall. From it the simulator
+derives consistent gyro, accel and mag data: the rates of the
+rotations, gravity and the linear accelerations seen in the body frame
+and the earth's field turned with the body. The chip simulation on top
+samples them at the ODRs and quantises them at the scales the driver
+sets up from IMUSettings. truth() gives the orientation and the
+quantities without the chip at any time, so that the output of an
+orientation filter can be compared against it.
+
+Orientations are unit quaternions {w, x, y, z} turning body into world
+coordinates. The world frame is the body frame at rest before the
+profile, in which the rest values of setRest() hold: gravity reads as
+the rest acceleration (+1 g along z by default) and the field is the
+rest field.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Motion_H__
+#define __LSM9DS1_Motion_H__
+
+#include <stdint.h>
+#include <vector>
+#include "LSM9DS1_Simulator.h"
+
+class LSM9DS1motionSimulator : public LSM9DS1simulator {
+public:
+	// Up to this many frequencies make up a vibration
+	static const unsigned maxFrequencies = 4;
+
+	LSM9DS1motionSimulator(uint8_t xgAddr = 0x6B, uint8_t mAddr = 0x1E);
+
+	// addStatic() -- Lies still.
+	void addStatic(double seconds);
+
+	// addRotation() -- Turns at a constant rate.
+	// Input:
+	//    - axis = rotation axis in body coordinates, normalised here
+	//    - dps = rate in degrees per second
+	void addRotation(double seconds, const float axis[3], float dps);
+
+	// addVibration() -- Shakes without turning: a sum of sines.
+	// Input:
+	//    - axis = direction in world coordinates, normalised here
+	//    - hz / amplitude = frequencies and their peak accelerations in g
+	//    - n = number of frequencies, up to maxFrequencies
+	void addVibration(double seconds, const float axis[3],
+			  const float* hz, const float* amplitude, unsigned n);
+
+	// addShock() -- A half sine pulse of acceleration at the start of
+	// the segment, then still.
+	// Input:
+	//    - axis = direction in world coordinates, normalised here
+	//    - peak = peak acceleration in g
+	//    - pulseSeconds = length of the pulse
+	void addShock(double seconds, const float axis[3], float peak, double pulseSeconds);
+
+	// addFreeFall() -- Falls: the accelerometer reads zero.
+	void addFreeFall(double seconds);
+
+	// clearProfile() -- Removes all segments.
+	void clearProfile();
+
+	// startProfile() -- Runs the profile from the current time of the
+	// simulation on. Before, and after its end, the body lies still.
+	// Calibrate (begin()) first as the chip would be calibrated at rest.
+	void startProfile();
+
+	// getDuration() -- Length of the profile in ns.
+	uint64_t getDuration() const {
+		return duration;
+	}
+
+	// truth() -- The motion at time t of the simulation (see now()).
+	// Input:
+	//    - t = time in ns
+	//    - q = receives the orientation {w, x, y, z}
+	//    - g, a, m = if not NULL receive rate (dps), acceleration (g)
+	//      and field (Gs) in body coordinates as the chip would measure
+	//      them without noise and quantisation
+	void truth(uint64_t t, float q[4], float g[3] = NULL,
+		   float a[3] = NULL, float m[3] = NULL) const;
+
+protected:
+	enum segment_type { MOTION_STATIC, MOTION_ROTATION, MOTION_VIBRATION,
+			    MOTION_SHOCK, MOTION_FREEFALL };
+	struct Segment {
+		segment_type type;
+		uint64_t start;		// relative to the profile start
+		uint64_t length;
+		float axis[3];
+		float rate;		// rad/s
+		float hz[maxFrequencies];
+		float amplitude[maxFrequencies];
+		unsigned n;
+		double pulse;		// s
+		double q0[4];		// orientation at the start
+	};
+	std::vector<Segment> segments;
+	uint64_t duration = 0;
+	uint64_t profileStart = 0;
+	bool started = false;
+
+	void add(Segment& segment, double seconds);
+
+	virtual void physical(uint64_t t, float g[3], float a[3], float m[3]);
+};
+
+#endif
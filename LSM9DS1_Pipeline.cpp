@@ -0,0 +1,197 @@
+/******************************************************************************
+LSM9DS1_Pipeline.cpp
+Processing pipeline and the stages shipped with the library.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <math.h>
+#include "LSM9DS1_Pipeline.h"
+#include "LSM9DS1_Source.h"
+#include "LSM9DS1_Trace.h"
+
+LSM9DS1pipeline::~LSM9DS1pipeline()
+{
+    for (size_t i = 0; i < stages.size(); i++) delete stages[i];
+}
+
+void LSM9DS1pipeline::add(LSM9DS1stage* stage)
+{
+    if (!stages.empty()) stages.back()->setNext(stage);
+    stage->setNext(output);
+    stages.push_back(stage);
+}
+
+void LSM9DS1pipeline::setOutput(LSM9DS1sampleSink* sink)
+{
+    output = sink;
+    if (!stages.empty()) stages.back()->setNext(sink);
+}
+
+void LSM9DS1pipeline::reset()
+{
+    for (size_t i = 0; i < stages.size(); i++) stages[i]->reset();
+}
+
+void LSM9DS1pipeline::hasSample(const LSM9DS1sample& sample)
+{
+    LSM9DS1_TRACE_SCOPE("pipeline");
+    if (!stages.empty()) stages.front()->hasSample(sample);
+    else if (output) output->hasSample(sample);
+}
+
+void LSM9DS1pipeline::blockEnd()
+{
+    if (!stages.empty()) stages.front()->blockEnd();
+    else if (output) output->blockEnd();
+}
+
+// Units per raw value of gyro, accel and mag at the scales in a scale code
+static void resolutions(uint8_t scale, float res[3])
+{
+    res[0] = LSM9DS1source::gyroResolution(LSM9DS1source::gyroScaleOf(scale));
+    res[1] = LSM9DS1source::accelResolution(LSM9DS1source::accelScaleOf(scale));
+    res[2] = LSM9DS1source::magResolution(LSM9DS1source::magScaleOf(scale));
+}
+
+// Rounded and saturated like the chip's outputs
+static inline int16_t toRaw(float v)
+{
+    if (v > 32767) return 32767;
+    if (v < -32768) return -32768;
+    return (int16_t)lrintf(v);
+}
+
+LSM9DS1calibrationStage::LSM9DS1calibrationStage(const int16_t gBias[3], const int16_t aBias[3],
+                                                 const int16_t mBias[3], uint8_t scale)
+{
+    float res[3];
+    resolutions(scale, res);
+    for (int i = 0; i < 3; i++) {
+        bias[i] = gBias[i] * res[0];
+        bias[i + 3] = aBias[i] * res[1];
+        bias[i + 6] = mBias[i] * res[2];
+    }
+}
+
+void LSM9DS1calibrationStage::hasSample(const LSM9DS1sample& sample)
+{
+    LSM9DS1_TRACE_SCOPE("calibration");
+    if (sample.scale != rawScale) {
+        float res[3];
+        resolutions(sample.scale, res);
+        for (int i = 0; i < 9; i++) rawBias[i] = toRaw(bias[i] / res[i / 3]);
+        rawScale = sample.scale;
+    }
+    LSM9DS1sample s = sample;
+    for (int i = 0; i < 3; i++) {
+        s.g[i] -= rawBias[i];
+        s.a[i] -= rawBias[i + 3];
+        s.m[i] -= rawBias[i + 6];
+    }
+    emit(s);
+}
+
+LSM9DS1lowpassStage::LSM9DS1lowpassStage(float alpha) : alpha(alpha)
+{
+}
+
+void LSM9DS1lowpassStage::reset()
+{
+    primed = false;
+}
+
+void LSM9DS1lowpassStage::hasSample(const LSM9DS1sample& sample)
+{
+    LSM9DS1_TRACE_SCOPE("lowpass");
+    int16_t* out[9];
+    LSM9DS1sample s = sample;
+    for (int i = 0; i < 3; i++) {
+        out[i] = &s.g[i];
+        out[i + 3] = &s.a[i];
+        out[i + 6] = &s.m[i];
+    }
+    if (primed && (sample.scale != scale)) {
+        // Carry the state over to the new scales
+        float from[3], to[3];
+        resolutions(scale, from);
+        resolutions(sample.scale, to);
+        for (int i = 0; i < 9; i++) state[i] *= from[i / 3] / to[i / 3];
+    }
+    scale = sample.scale;
+    for (int i = 0; i < 9; i++) {
+        if (primed) state[i] += alpha * (*out[i] - state[i]);
+        else state[i] = *out[i];
+        *out[i] = toRaw(state[i]);
+    }
+    primed = true;
+    emit(s);
+}
+
+LSM9DS1oversampleStage::LSM9DS1oversampleStage(unsigned factor, LSM9DS1oversampledSink* sink)
+    : factor(factor), sink(sink)
+{
+    // 4096 * 32768 still fits into the int32 sums
+    if (this->factor < 2) this->factor = 2;
+    if (this->factor > 4096) this->factor = 4096;
+    unsigned log2n = 0;
+    while ((2u << log2n) <= this->factor) log2n++;
+    fracBits = log2n / 2;
+}
+
+void LSM9DS1oversampleStage::reset()
+{
+    count = 0;
+}
+
+void LSM9DS1oversampleStage::hasSample(const LSM9DS1sample& sample)
+{
+    LSM9DS1_TRACE_SCOPE("oversample");
+    if (count && (sample.scale != scale)) average();
+    if (count == 0) {
+        for (int i = 0; i < 9; i++) sum[i] = 0;
+        firstTimestamp = sample.timestamp;
+        timestampSum = 0;
+        flags = 0;
+        scale = sample.scale;
+    }
+    for (int i = 0; i < 3; i++) {
+        sum[i] += sample.g[i];
+        sum[i + 3] += sample.a[i];
+        sum[i + 6] += sample.m[i];
+    }
+    timestampSum += sample.timestamp - firstTimestamp;
+    flags |= sample.flags;
+    if (++count == factor) average();
+}
+
+// Rounded division, halves away from zero
+static inline int32_t divRound(int64_t v, int64_t d)
+{
+    return (int32_t)(v >= 0 ? (v + d / 2) / d : -((-v + d / 2) / d));
+}
+
+void LSM9DS1oversampleStage::average()
+{
+    LSM9DS1oversampled o;
+    o.timestamp = firstTimestamp + timestampSum / count;
+    o.fracBits = fracBits;
+    o.count = count;
+    o.flags = flags;
+    o.scale = scale;
+    LSM9DS1sample s;
+    s.timestamp = o.timestamp;
+    s.flags = flags;
+    s.scale = scale;
+    for (int i = 0; i < 3; i++) {
+        o.g[i] = divRound((int64_t)sum[i] << fracBits, count);
+        o.a[i] = divRound((int64_t)sum[i + 3] << fracBits, count);
+        o.m[i] = divRound((int64_t)sum[i + 6] << fracBits, count);
+        s.g[i] = (int16_t)divRound(sum[i], count);
+        s.a[i] = (int16_t)divRound(sum[i + 3], count);
+        s.m[i] = (int16_t)divRound(sum[i + 6], count);
+    }
+    count = 0;
+    if (sink) sink->hasOversampled(o);
+    emit(s);
+}
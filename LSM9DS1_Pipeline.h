@@ -0,0 +1,161 @@
+/******************************************************************************
+LSM9DS1_Pipeline.h
+Chainable processing stages for raw LSM9DS1 samples.
+
+A pipeline is a sample sink which passes each sample through its stages
+and hands the result to an output sink. The same setup function can build
+the pipeline behind the live device (setSampleSink()) and behind the
+offline batch reprocessing (LSM9DS1_Batch.h), so both run identical code.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Pipeline_H__
+#define __LSM9DS1_Pipeline_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "LSM9DS1_Sample.h"
+
+class LSM9DS1stage : public LSM9DS1sampleSink {
+public:
+	void setNext(LSM9DS1sampleSink* sink) {
+		next = sink;
+	}
+
+	// reset() -- Forgets all state as if no sample had been seen.
+	virtual void reset() {}
+
+	virtual void blockEnd() {
+		if (next) next->blockEnd();
+	}
+
+protected:
+	LSM9DS1sampleSink* next = NULL;
+
+	void emit(const LSM9DS1sample& sample) {
+		if (next) next->hasSample(sample);
+	}
+};
+
+class LSM9DS1pipeline : public LSM9DS1sampleSink {
+public:
+	~LSM9DS1pipeline();
+
+	// add() -- Appends a stage. The pipeline takes ownership.
+	void add(LSM9DS1stage* stage);
+
+	// setOutput() -- Where the processed samples go.
+	void setOutput(LSM9DS1sampleSink* sink);
+
+	// reset() -- Resets every stage.
+	void reset();
+
+	virtual void hasSample(const LSM9DS1sample& sample);
+	virtual void blockEnd();
+
+protected:
+	std::vector<LSM9DS1stage*> stages;
+	LSM9DS1sampleSink* output = NULL;
+};
+
+// Subtracts constant biases, for example ones from a new calibration.
+// They are kept in physical units and converted to the scales of each
+// sample, so they stay right across a change of the full scale.
+class LSM9DS1calibrationStage : public LSM9DS1stage {
+public:
+	// Input:
+	//    - gBias, aBias, mBias = raw biases of gyro, accel and mag
+	//    - scale = the full scales they were measured at, packed with
+	//      LSM9DS1source::scaleCode()
+	LSM9DS1calibrationStage(const int16_t gBias[3], const int16_t aBias[3],
+				const int16_t mBias[3], uint8_t scale);
+	virtual void hasSample(const LSM9DS1sample& sample);
+
+protected:
+	float bias[9];		// gyro, accel and mag in dps, g and Gs
+	int16_t rawBias[9];	// at rawScale
+	uint8_t rawScale = 0xff;
+};
+
+// First order lowpass on every channel: y += alpha * (x - y)
+// The state is rescaled when the full scale of the samples changes so
+// that raw values of different scales are never mixed.
+class LSM9DS1lowpassStage : public LSM9DS1stage {
+public:
+	// Input:
+	//    - alpha = smoothing factor between 0 (frozen) and 1 (no filtering)
+	LSM9DS1lowpassStage(float alpha);
+	virtual void hasSample(const LSM9DS1sample& sample);
+	virtual void reset();
+
+protected:
+	float alpha;
+	float state[9];
+	uint8_t scale;		// of the state
+	bool primed = false;
+};
+
+// Average of several raw samples in fixed point: the raw value of the
+// sensor is g[i] / 2^fracBits. Convert with the resolutions of the scales
+// (LSM9DS1source::gyroResolution(LSM9DS1source::gyroScaleOf(scale)) etc.).
+struct LSM9DS1oversampled
+{
+	uint64_t timestamp;	// mean acquisition time of the samples
+	int32_t g[3];		// gyroscope x, y, z in raw units * 2^fracBits
+	int32_t a[3];		// accelerometer x, y, z in raw units * 2^fracBits
+	int32_t m[3];		// magnetometer x, y, z in raw units * 2^fracBits
+	uint8_t fracBits;	// fractional bits of g, a and m
+	uint16_t count;		// number of samples averaged
+	uint16_t flags;		// OR'd sample_flags of the samples
+	uint8_t scale;		// full scales of the samples
+};
+
+class LSM9DS1oversampledSink {
+public:
+	virtual void hasOversampled(const LSM9DS1oversampled& sample) = 0;
+	virtual ~LSM9DS1oversampledSink() {}
+};
+
+// Oversampling and averaging: sums every factor samples in int32 and
+// emits their mean. Averaging N samples of white noise gains
+// log2(N) / 2 bits, which are kept as fractional bits in the fixed point
+// samples handed to the oversampled sink. The next stage gets the mean
+// rounded to a raw sample so that logging and the callback work as
+// before, only at the lower rate. Run the gyro and accel fast and drain
+// them through the FIFO (LSM9DS1::enableFIFOStreaming()) in front of it.
+// A change of the full scale ends the average early so that samples of
+// different scales are never mixed.
+class LSM9DS1oversampleStage : public LSM9DS1stage {
+public:
+	// Input:
+	//    - factor = number of samples averaged into one (2-4096)
+	//    - sink = receives the fixed point averages, can be NULL
+	LSM9DS1oversampleStage(unsigned factor, LSM9DS1oversampledSink* sink = NULL);
+	virtual void hasSample(const LSM9DS1sample& sample);
+	virtual void reset();
+
+	// The averages don't line up with the FIFO drains: the drain ends
+	// aren't passed on.
+	virtual void blockEnd() {}
+
+	// Fractional bits of the oversampled samples.
+	uint8_t getFracBits() const {
+		return fracBits;
+	}
+
+protected:
+	unsigned factor;
+	uint8_t fracBits;
+	LSM9DS1oversampledSink* sink;
+	int32_t sum[9];
+	uint64_t firstTimestamp;
+	uint64_t timestampSum;
+	unsigned count = 0;
+	uint16_t flags;
+	uint8_t scale;
+	void average();
+};
+
+#endif
@@ -0,0 +1,93 @@
+/******************************************************************************
+LSM9DS1_Range.h
+Pull interface to a stream of samples.
+
+Live and recorded samples can be consumed the same way, as a range:
+
+    LSM9DS1logReader log("walk.log");
+    for (const LSM9DS1sample& s : log) ...
+
+    LSM9DS1asyncSink live;
+    imu.setSampleSink(&live);
+    live.setBlocking(true);
+    for (const LSM9DS1sample& s : live) ...
+
+    LSM9DS1logWindow window("walk.log", t0, t1);
+    for (const LSM9DS1sample& s : window) ...
+
+The iterator hands out references into the storage of the stream (the
+decoded block of the log, the sample the sink has copied out of its
+ring), which stay valid until it is advanced. A stream can be iterated
+once; the loop ends when pull() returns NULL.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Range_H__
+#define __LSM9DS1_Range_H__
+
+#include <stddef.h>
+#include <iterator>
+#include "LSM9DS1_Sample.h"
+
+class LSM9DS1sampleStream;
+
+class LSM9DS1sampleIterator {
+public:
+	typedef std::input_iterator_tag iterator_category;
+	typedef LSM9DS1sample value_type;
+	typedef ptrdiff_t difference_type;
+	typedef const LSM9DS1sample* pointer;
+	typedef const LSM9DS1sample& reference;
+
+	// The end of any stream
+	LSM9DS1sampleIterator() {}
+	inline explicit LSM9DS1sampleIterator(LSM9DS1sampleStream* stream);
+
+	reference operator*() const {
+		return *current;
+	}
+	pointer operator->() const {
+		return current;
+	}
+	inline LSM9DS1sampleIterator& operator++();
+	bool operator==(const LSM9DS1sampleIterator& other) const {
+		return current == other.current;
+	}
+	bool operator!=(const LSM9DS1sampleIterator& other) const {
+		return current != other.current;
+	}
+
+private:
+	LSM9DS1sampleStream* stream = NULL;
+	const LSM9DS1sample* current = NULL;
+};
+
+class LSM9DS1sampleStream {
+public:
+	// pull() -- The next sample, valid until the next call.
+	// Output: NULL at the end of the stream.
+	virtual const LSM9DS1sample* pull() = 0;
+
+	LSM9DS1sampleIterator begin() {
+		return LSM9DS1sampleIterator(this);
+	}
+	LSM9DS1sampleIterator end() {
+		return LSM9DS1sampleIterator();
+	}
+
+	virtual ~LSM9DS1sampleStream() {}
+};
+
+LSM9DS1sampleIterator::LSM9DS1sampleIterator(LSM9DS1sampleStream* stream)
+	: stream(stream), current(stream->pull())
+{
+}
+
+LSM9DS1sampleIterator& LSM9DS1sampleIterator::operator++()
+{
+	current = stream->pull();
+	return *this;
+}
+
+#endif
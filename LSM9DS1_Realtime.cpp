@@ -0,0 +1,132 @@
+/******************************************************************************
+LSM9DS1_Realtime.cpp
+Memory locking, prefaulting, CPU affinity and scheduling.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <alloca.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include "LSM9DS1_Realtime.h"
+
+static void fail(LSM9DS1realtimeStep& step, int error)
+{
+    step.status = RT_FAILED;
+    step.error = error;
+}
+
+static const char* statusText(realtime_status status)
+{
+    switch (status) {
+    case RT_OK:
+        return "ok";
+    case RT_FAILED:
+        return "failed";
+    default:
+        return "skipped";
+    }
+}
+
+bool LSM9DS1realtimeReport::ok() const
+{
+    return (lockMemory.status != RT_FAILED) && (prefaultStack.status != RT_FAILED) &&
+        (prefaultBuffers.status != RT_FAILED) && (pinCPU.status != RT_FAILED) &&
+        (scheduling.status != RT_FAILED);
+}
+
+void LSM9DS1realtimeReport::print(FILE* f) const
+{
+    const char* names[] = {"lockMemory", "prefaultStack", "prefaultBuffers",
+                           "pinCPU", "scheduling"};
+    const LSM9DS1realtimeStep* steps[] = {&lockMemory, &prefaultStack, &prefaultBuffers,
+                                          &pinCPU, &scheduling};
+    for (int i = 0; i < 5; i++) {
+        if (steps[i]->status == RT_FAILED)
+            fprintf(f, "%s: %s (%s)\n", names[i], statusText(steps[i]->status),
+                    strerror(steps[i]->error));
+        else
+            fprintf(f, "%s: %s\n", names[i], statusText(steps[i]->status));
+    }
+}
+
+bool LSM9DS1realtime::addBuffer(void* buffer, size_t bytes)
+{
+    if (nBuffers == maxBuffers) return false;
+    buffers[nBuffers] = buffer;
+    sizes[nBuffers] = bytes;
+    nBuffers++;
+    return true;
+}
+
+void LSM9DS1realtime::prefault(void* buffer, size_t bytes)
+{
+    const size_t page = sysconf(_SC_PAGESIZE);
+    volatile char* p = (volatile char*)buffer;
+    // A write, as reading maps the shared zero page only
+    for (size_t i = 0; i < bytes; i += page) p[i] = p[i];
+    if (bytes) p[bytes - 1] = p[bytes - 1];
+}
+
+// Grows the stack by the given size and writes to it. Not inlined so
+// that the array is really on the stack below the caller.
+static void __attribute__((noinline)) prefaultStack(size_t bytes)
+{
+    volatile char* stack = (volatile char*)alloca(bytes);
+    const size_t page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < bytes; i += page) stack[i] = 0;
+}
+
+LSM9DS1realtimeReport LSM9DS1realtime::apply()
+{
+    LSM9DS1realtimeReport report;
+
+    // First, so that everything touched below stays in memory
+    if (settings.lockMemory) {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) fail(report.lockMemory, errno);
+        else report.lockMemory.status = RT_OK;
+    }
+
+    if (settings.stackBytes) {
+        struct rlimit limit;
+        if ((getrlimit(RLIMIT_STACK, &limit) == 0) && (limit.rlim_cur != RLIM_INFINITY) &&
+            (settings.stackBytes + 64 * 1024 > limit.rlim_cur)) {
+            fail(report.prefaultStack, ENOMEM);
+        } else {
+            prefaultStack(settings.stackBytes);
+            report.prefaultStack.status = RT_OK;
+        }
+    }
+
+    if (nBuffers) {
+        for (unsigned i = 0; i < nBuffers; i++) prefault(buffers[i], sizes[i]);
+        report.prefaultBuffers.status = RT_OK;
+    }
+
+    if (settings.cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(settings.cpu, &set);
+        const int r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (r) fail(report.pinCPU, r);
+        else report.pinCPU.status = RT_OK;
+    }
+
+    if (settings.priority) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = settings.priority;
+        const int r = pthread_setschedparam(pthread_self(), settings.policy, &param);
+        if (r) fail(report.scheduling, r);
+        else report.scheduling.status = RT_OK;
+    }
+
+    return report;
+}
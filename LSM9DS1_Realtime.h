@@ -0,0 +1,89 @@
+/******************************************************************************
+LSM9DS1_Realtime.h
+Prepares the acquisition thread for real-time scheduling.
+
+Running the timer events at SCHED_FIFO is not enough by itself: every
+page touched for the first time is a page fault which can stall the
+acquisition for milliseconds. LSM9DS1realtime locks the memory of the
+process, touches the stack and the given buffers in advance, pins the
+calling thread to a CPU and sets its scheduling policy and priority.
+Each step is optional and reports on its own whether it worked, so
+that an unprivileged run still gets what it is allowed to have.
+
+Call apply() after begin() and after constructing the sinks, from the
+thread which receives the timer signal (normally the main thread;
+block SIGRTMIN in all other threads).
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Realtime_H__
+#define __LSM9DS1_Realtime_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sched.h>
+
+enum realtime_status
+{
+	RT_SKIPPED = 0,	// not asked for
+	RT_OK,		// done
+	RT_FAILED,	// tried, see error
+};
+
+struct LSM9DS1realtimeStep
+{
+	realtime_status status = RT_SKIPPED;
+	int error = 0;		// errno of the failure
+};
+
+struct LSM9DS1realtimeReport
+{
+	LSM9DS1realtimeStep lockMemory;
+	LSM9DS1realtimeStep prefaultStack;
+	LSM9DS1realtimeStep prefaultBuffers;
+	LSM9DS1realtimeStep pinCPU;
+	LSM9DS1realtimeStep scheduling;
+
+	// ok() -- True if no step which was asked for failed.
+	bool ok() const;
+
+	// print() -- One line per step, for example "lockMemory: failed
+	// (Operation not permitted)".
+	void print(FILE* f = stderr) const;
+};
+
+struct LSM9DS1realtimeSettings
+{
+	bool lockMemory = true;		// mlockall() of current and future pages
+	size_t stackBytes = 256 * 1024;	// stack to touch in advance, 0 skips it
+	int cpu = -1;			// CPU to pin the thread to, -1 skips it
+	int policy = SCHED_FIFO;	// scheduling policy
+	int priority = 0;		// its priority, 0 leaves the scheduling alone
+};
+
+class LSM9DS1realtime {
+public:
+	static const unsigned maxBuffers = 16;
+
+	LSM9DS1realtimeSettings settings;
+
+	// addBuffer() -- Touches the buffer's pages in apply(), for buffers
+	// which are allocated but not yet written to. Their content stays.
+	// Output: false if there are already maxBuffers.
+	bool addBuffer(void* buffer, size_t bytes);
+
+	// apply() -- Runs the steps of the settings on the calling thread.
+	LSM9DS1realtimeReport apply();
+
+	// prefault() -- Touches every page of a buffer, keeping its content.
+	// Must not run while others write to it.
+	static void prefault(void* buffer, size_t bytes);
+
+protected:
+	void* buffers[maxBuffers];
+	size_t sizes[maxBuffers];
+	unsigned nBuffers = 0;
+};
+
+#endif
@@ -0,0 +1,50 @@
+/******************************************************************************
+LSM9DS1_Replay.cpp
+Log replay source.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <time.h>
+#include <errno.h>
+#include "LSM9DS1_Replay.h"
+
+LSM9DS1replay::LSM9DS1replay(const char* filename) : reader(filename), running(false)
+{
+}
+
+unsigned long LSM9DS1replay::run(replay_mode mode, double speed)
+{
+    if ((mode == REPLAY_REALTIME) || (speed <= 0)) speed = 1.0;
+    reader.rewind();
+    running = true;
+
+    // Pacing is done against absolute wakeup times so that sleep
+    // latencies don't accumulate.
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    const uint64_t startNs = (uint64_t)start.tv_sec * 1000000000 + start.tv_nsec;
+
+    unsigned long n = 0;
+    uint64_t firstTimestamp = 0;
+    LSM9DS1sample sample;
+    while (running && reader.next(sample)) {
+        if (n == 0) firstTimestamp = sample.timestamp;
+        if (mode != REPLAY_FAST) {
+            const uint64_t due = startNs +
+                (uint64_t)((sample.timestamp - firstTimestamp) / speed);
+            struct timespec ts;
+            ts.tv_sec = due / 1000000000;
+            ts.tv_nsec = due % 1000000000;
+            // Again only if a signal interrupted it, any other error
+            // (it returns the error number) would come back every time
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+                ;
+        }
+        dispatch(sample);
+        if (sampleSink && reader.atBlockEnd()) sampleSink->blockEnd();
+        n++;
+    }
+    running = false;
+    return n;
+}
@@ -0,0 +1,55 @@
+/******************************************************************************
+LSM9DS1_Replay.h
+Feeds a recorded log through the same callback and sink interfaces as the
+live device.
+
+The samples are converted with the scales recorded with them and passed
+through LSM9DS1source::dispatch(), exactly as timerEvent() does it, so a
+replay is bit-identical to the live run and can be repeated at will to
+compare processing changes offline.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Replay_H__
+#define __LSM9DS1_Replay_H__
+
+#include <atomic>
+#include "LSM9DS1_Source.h"
+#include "LSM9DS1_Log.h"
+
+enum replay_mode
+{
+	REPLAY_REALTIME,	// original timing
+	REPLAY_ACCELERATED,	// original timing divided by the speed factor
+	REPLAY_FAST		// as fast as possible
+};
+
+class LSM9DS1replay : public LSM9DS1source {
+public:
+	// Opens the log. Throws if it's not a valid log file.
+	LSM9DS1replay(const char* filename);
+
+	// run() -- Replays the whole log in the calling thread.
+	// Input:
+	//    - mode = pacing of the samples
+	//    - speed = speed up factor for REPLAY_ACCELERATED
+	// Output: number of samples replayed.
+	unsigned long run(replay_mode mode = REPLAY_FAST, double speed = 1.0);
+
+	// Makes run() return after the current sample. Can be called from
+	// any thread or from a callback.
+	void stop() {
+		running = false;
+	}
+
+	const LSM9DS1logHeader& getHeader() const {
+		return reader.getHeader();
+	}
+
+protected:
+	LSM9DS1logReader reader;
+	std::atomic<bool> running;
+};
+
+#endif
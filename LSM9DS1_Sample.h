@@ -0,0 +1,57 @@
+/******************************************************************************
+LSM9DS1_Sample.h
+Raw sample record and sink interface of the LSM9DS1 library.
+
+A sample is the 9-axis reading exactly as it comes off the bus (after the
+optional bias subtraction of calibrate()) together with its acquisition
+time. Everything which stores, forwards or replays data works on these
+records so that scaling to physical units happens only once, at the end.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Sample_H__
+#define __LSM9DS1_Sample_H__
+
+#include <stdint.h>
+
+// sample_flags mark events on the sample they occurred with. Any OR'd
+// combination can be set in LSM9DS1sample::flags.
+enum sample_flags
+{
+	SAMPLE_ACCEL_INT = (1<<0),	// accel interrupt generator active (IA_XL)
+	SAMPLE_ODR_CHANGE = (1<<1),	// first sample at a new output data rate
+	SAMPLE_INACTIVE = (1<<2),	// stationary: gyro asleep, g not measured
+	SAMPLE_ACTIVITY_CHANGE = (1<<3),	// first sample after a change of activity
+	SAMPLE_SCALE_CHANGE = (1<<4),	// first sample at a new full scale
+	SAMPLE_GAP = (1<<5),	// samples were lost right before this one
+};
+
+struct LSM9DS1sample
+{
+	uint64_t timestamp;	// CLOCK_MONOTONIC in nanoseconds
+	int16_t g[3];		// raw gyroscope x, y, z
+	int16_t a[3];		// raw accelerometer x, y, z
+	int16_t m[3];		// raw magnetometer x, y, z
+	uint16_t flags;		// OR'd sample_flags
+	uint8_t scale;		// full scales it was taken with, see LSM9DS1source::scaleCode()
+};
+
+class LSM9DS1sampleSink {
+public:
+	/**
+	 * Called with every raw sample in acquisition order.
+	 **/
+	virtual void hasSample(const LSM9DS1sample& sample) = 0;
+
+	/**
+	 * Called after a batch of samples which belong together,
+	 * for example one FIFO drain. Sinks may use it to align
+	 * their own blocks to the ones of the sensor.
+	 **/
+	virtual void blockEnd() {}
+
+	virtual ~LSM9DS1sampleSink() {}
+};
+
+#endif
@@ -0,0 +1,349 @@
+/******************************************************************************
+LSM9DS1_Simulator.cpp
+Register map, output quantisation and FIFO of the simulated LSM9DS1.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <time.h>
+#include <math.h>
+#include <string.h>
+#include "LSM9DS1_Simulator.h"
+#include "LSM9DS1_Registers.h"
+#include "LSM9DS1_Source.h"
+
+// Output data rates in Hz, indexed by the ODR bits
+static const double gyroODRHz[8] = {0, 14.9, 59.5, 119, 238, 476, 952, 0};
+static const double accelODRHz[8] = {0, 10, 50, 119, 238, 476, 952, 0};
+static const double magODRHz[8] = {0.625, 1.25, 2.5, 5, 10, 20, 40, 80};
+
+static uint64_t monotonic()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+LSM9DS1simulator::LSM9DS1simulator(uint8_t xgAddr, uint8_t mAddr)
+    : xgAddress(xgAddr), mAddress(mAddr)
+{
+    memset(xgRegs, 0, sizeof(xgRegs));
+    memset(mRegs, 0, sizeof(mRegs));
+    xgRegs[WHO_AM_I_XG] = WHO_AM_I_AG_RSP;
+    xgRegs[CTRL_REG4] = 0x38;
+    xgRegs[CTRL_REG5_XL] = 0x38;
+    xgRegs[CTRL_REG8] = 0x04;
+    mRegs[WHO_AM_I_M] = WHO_AM_I_M_RSP;
+    mRegs[CTRL_REG1_M] = 0x10;
+    mRegs[CTRL_REG3_M] = 0x03;
+    for (int i = 0; i < 3; i++) {
+        restG[i] = 0;
+        restA[i] = 0;
+    }
+    // Lying flat, roughly the field in the UK
+    restA[2] = 1;
+    restM[0] = 0.18f;
+    restM[1] = 0;
+    restM[2] = -0.45f;
+    epoch = monotonic();
+    clearNoise();
+}
+
+uint64_t LSM9DS1simulator::now() const
+{
+    return manual ? manualTime : monotonic() - epoch;
+}
+
+void LSM9DS1simulator::setManualClock(bool manual)
+{
+    if (manual == this->manual) return;
+    if (manual) {
+        manualTime = now();
+    } else {
+        // Carry on from the manual time
+        epoch = monotonic() - manualTime;
+    }
+    this->manual = manual;
+}
+
+void LSM9DS1simulator::setRest(const float g[3], const float a[3], const float m[3])
+{
+    for (int i = 0; i < 3; i++) {
+        restG[i] = g[i];
+        restA[i] = a[i];
+        restM[i] = m[i];
+    }
+}
+
+void LSM9DS1simulator::setNoise(const LSM9DS1noise& g, const LSM9DS1noise& a,
+                                const LSM9DS1noise& m, uint64_t seed)
+{
+    noise[0] = g;
+    noise[1] = a;
+    noise[2] = m;
+    random = seed ? seed : 1;
+    for (int s = 0; s < 3; s++) {
+        for (int i = 0; i < 3; i++) {
+            turnOnBias[s][i] = noise[s].turnOn * gaussian();
+            tempCoefficient[s][i] = noise[s].temperature * gaussian();
+            // The instability starts in its steady state
+            markov[s][i] = noise[s].instability * gaussian();
+            walk[s][i] = 0;
+        }
+    }
+    noiseTime = now();
+    noisy = true;
+}
+
+void LSM9DS1simulator::clearNoise()
+{
+    noisy = false;
+    random = 1;
+    for (int s = 0; s < 3; s++) {
+        noise[s] = LSM9DS1noise();
+        for (int i = 0; i < 3; i++) {
+            turnOnBias[s][i] = tempCoefficient[s][i] = 0;
+            markov[s][i] = walk[s][i] = 0;
+        }
+    }
+}
+
+// Standard normal numbers: xorshift64* and Box-Muller
+float LSM9DS1simulator::gaussian()
+{
+    double u[2];
+    for (int k = 0; k < 2; k++) {
+        random ^= random >> 12;
+        random ^= random << 25;
+        random ^= random >> 27;
+        const uint64_t r = random * 0x2545F4914F6CDD1DULL;
+        u[k] = ((r >> 11) + 0.5) / 9007199254740992.0;
+    }
+    return (float)(sqrt(-2 * log(u[0])) * cos(2 * M_PI * u[1]));
+}
+
+double LSM9DS1simulator::magODR() const
+{
+    return magODRHz[(mRegs[CTRL_REG1_M] >> 2) & 0x7];
+}
+
+// Adds the errors to gyro, accel and mag read at time t
+void LSM9DS1simulator::addNoise(uint64_t t, float* values[3])
+{
+    // The biases move on with time. FIFO entries may be read after
+    // newer outputs: they get the biases as they are.
+    const double dt = t > noiseTime ? (t - noiseTime) / 1e9 : 0;
+    if (t > noiseTime) noiseTime = t;
+    const double period = odrPeriod() / 1e9;
+    const double rates[3] = {period > 0 ? 1 / period : 0, period > 0 ? 1 / period : 0,
+                             magODR()};
+    for (int s = 0; s < 3; s++) {
+        const LSM9DS1noise& n = noise[s];
+        // The white noise of a sample is its density times the root of
+        // the rate at which it is sampled
+        const float white = n.density * (float)sqrt(rates[s]);
+        for (int i = 0; i < 3; i++) {
+            if (dt > 0) {
+                if ((n.instability > 0) && (n.correlation > 0)) {
+                    const double decay = exp(-dt / n.correlation);
+                    markov[s][i] = (float)(markov[s][i] * decay +
+                                           n.instability * sqrt(1 - decay * decay) * gaussian());
+                }
+                if (n.randomWalk > 0) walk[s][i] += (float)(n.randomWalk * sqrt(dt) * gaussian());
+            }
+            float v = turnOnBias[s][i] + tempCoefficient[s][i] * (temperature - 25) +
+                markov[s][i] + walk[s][i];
+            if (white > 0) v += white * gaussian();
+            values[s][i] += v;
+        }
+    }
+}
+
+void LSM9DS1simulator::physical(uint64_t, float g[3], float a[3], float m[3])
+{
+    for (int i = 0; i < 3; i++) {
+        g[i] = restG[i];
+        a[i] = restA[i];
+        m[i] = restM[i];
+    }
+}
+
+uint64_t LSM9DS1simulator::odrPeriod() const
+{
+    // With the gyro on the accel runs at its rate
+    double hz = gyroODRHz[xgRegs[CTRL_REG1_G] >> 5];
+    if (hz == 0) hz = accelODRHz[xgRegs[CTRL_REG6_XL] >> 5];
+    return hz > 0 ? (uint64_t)(1e9 / hz) : 0;
+}
+
+bool LSM9DS1simulator::fifoEnabled() const
+{
+    return (xgRegs[CTRL_REG9] & 0x02) && (xgRegs[FIFO_CTRL] >> 5);
+}
+
+void LSM9DS1simulator::resetFIFO()
+{
+    fifoFirst = 0;
+    fifoLevel = 0;
+    fifoOverrun = false;
+    const uint64_t period = odrPeriod();
+    fifoTick = period ? now() / period : 0;
+}
+
+void LSM9DS1simulator::updateFIFO()
+{
+    const uint64_t period = odrPeriod();
+    if ((!fifoEnabled()) || (!period)) return;
+    const uint64_t tick = now() / period;
+    if (tick <= fifoTick) return;
+    // FIFO mode stops when full, the others overwrite the oldest entry
+    const bool stopWhenFull = (xgRegs[FIFO_CTRL] >> 5) == 1;
+    uint64_t k = fifoTick + 1;
+    if (!stopWhenFull) {
+        if (tick - fifoTick + fifoLevel > fifoDepth) fifoOverrun = true;
+        if (tick - k + 1 > fifoDepth) k = tick - fifoDepth + 1;
+    }
+    for (; k <= tick; k++) {
+        if (fifoLevel == fifoDepth) {
+            if (stopWhenFull) break;
+            fifoFirst = (fifoFirst + 1) % fifoDepth;
+            fifoLevel--;
+        }
+        fifo[(fifoFirst + fifoLevel) % fifoDepth] = k * period;
+        fifoScales[(fifoFirst + fifoLevel) % fifoDepth] = outputScales();
+        fifoLevel++;
+    }
+    fifoTick = tick;
+}
+
+// Quantises at the resolution and saturates like the chip at the
+// ends of the 16 bit range
+static inline void putRaw(uint8_t* regs, float value, float res)
+{
+    long raw = lrintf(value / res);
+    if (raw > 32767) raw = 32767;
+    if (raw < -32768) raw = -32768;
+    regs[0] = (uint8_t)(raw & 0xff);
+    regs[1] = (uint8_t)((raw >> 8) & 0xff);
+}
+
+uint8_t LSM9DS1simulator::outputScales() const
+{
+    return ((xgRegs[CTRL_REG1_G] >> 3) & 0x3) | (((xgRegs[CTRL_REG6_XL] >> 3) & 0x3) << 2);
+}
+
+// The chip converts at the scales of the moment a sample is taken:
+// FIFO entries keep theirs across a change of the full scale.
+void LSM9DS1simulator::putOutputs(uint64_t t, uint8_t scales)
+{
+    static const uint16_t gyroScales[4] = {245, 500, 245, 2000};
+    static const uint8_t accelScales[4] = {2, 16, 4, 8};
+    const float gRes = LSM9DS1source::gyroResolution(gyroScales[scales & 0x3]);
+    const float aRes = LSM9DS1source::accelResolution(accelScales[(scales >> 2) & 0x3]);
+    const float mRes = LSM9DS1source::magResolution(4 * (((mRegs[CTRL_REG2_M] >> 5) & 0x3) + 1));
+    float g[3], a[3], m[3];
+    physical(t, g, a, m);
+    if (noisy) {
+        float* values[3] = {g, a, m};
+        addNoise(t, values);
+    }
+    // 16 LSB per degree, 0 at 25 C
+    putRaw(xgRegs + OUT_TEMP_L, temperature - 25, 1.0f / 16);
+    for (int i = 0; i < 3; i++) {
+        putRaw(xgRegs + OUT_X_L_G + 2 * i, g[i], gRes);
+        putRaw(xgRegs + OUT_X_L_XL + 2 * i, a[i], aRes);
+        putRaw(mRegs + OUT_X_L_M + 2 * i, m[i], mRes);
+    }
+    latched = t;
+    latchedScales = scales;
+}
+
+uint8_t LSM9DS1simulator::readRegister(bool xg, uint8_t reg)
+{
+    if (!xg) {
+        if (reg == STATUS_REG_M) return 0x0F;
+        return mRegs[reg];
+    }
+    switch (reg) {
+    case STATUS_REG_0:
+    case STATUS_REG_1:
+        // New data of accel, gyro and temperature
+        return 0x07;
+    case FIFO_SRC: {
+        // [FTH][OVRN][FSS5:0]
+        updateFIFO();
+        uint8_t src = fifoLevel & 0x3F;
+        if (fifoOverrun) src |= (1<<6);
+        if (fifoLevel >= (unsigned)(xgRegs[FIFO_CTRL] & 0x1F)) src |= (1<<7);
+        fifoOverrun = false;
+        return src;
+    }
+    default:
+        return xgRegs[reg];
+    }
+}
+
+void LSM9DS1simulator::writeByte(uint8_t address, uint8_t subAddress, uint8_t data)
+{
+    subAddress &= 0x7F;
+    if (address == mAddress) {
+        mRegs[subAddress] = data;
+        return;
+    }
+    if (address != xgAddress) return;
+    switch (subAddress) {
+    case CTRL_REG1_G:
+    case CTRL_REG6_XL:
+        // A new rate or scale: entries so far stay, new ones come at
+        // the new one
+        updateFIFO();
+        xgRegs[subAddress] = data;
+        if (odrPeriod()) fifoTick = now() / odrPeriod();
+        break;
+    case CTRL_REG9:
+    case FIFO_CTRL:
+        xgRegs[subAddress] = data;
+        resetFIFO();
+        break;
+    default:
+        xgRegs[subAddress] = data;
+    }
+}
+
+uint8_t LSM9DS1simulator::readByte(uint8_t address, uint8_t subAddress)
+{
+    uint8_t data = 0;
+    readBytes(address, subAddress, &data, 1);
+    return data;
+}
+
+uint8_t LSM9DS1simulator::readBytes(uint8_t address, uint8_t subAddress,
+                                    uint8_t* dest, uint8_t count)
+{
+    subAddress &= 0x7F;
+    const bool xg = address == xgAddress;
+    if ((!xg) && (address != mAddress)) throw 999;
+    if (subAddress + count > 128) count = 128 - subAddress;
+    const unsigned last = subAddress + count - 1;
+    const bool gyroOut = xg && (subAddress <= OUT_Z_H_G) && (last >= OUT_X_L_G);
+    const bool accelOut = xg && (subAddress <= OUT_Z_H_XL) && (last >= OUT_X_L_XL);
+    const bool magOut = (!xg) && (subAddress <= OUT_Z_H_M) && (last >= OUT_X_L_M);
+    if (gyroOut || accelOut) {
+        if (fifoEnabled()) {
+            // The oldest entry until the accel read pops it
+            updateFIFO();
+            if (fifoLevel) putOutputs(fifo[fifoFirst], fifoScales[fifoFirst]);
+            else putOutputs(latched, latchedScales);
+        } else {
+            putOutputs(now(), outputScales());
+        }
+    } else if (magOut) {
+        putOutputs(now(), outputScales());
+    }
+    for (uint8_t i = 0; i < count; i++) dest[i] = readRegister(xg, subAddress + i);
+    if (accelOut && (last >= OUT_Z_H_XL) && fifoEnabled() && fifoLevel) {
+        fifoFirst = (fifoFirst + 1) % fifoDepth;
+        fifoLevel--;
+    }
+    return count;
+}
@@ -0,0 +1,156 @@
+/******************************************************************************
+LSM9DS1_Simulator.h
+Register level simulation of the LSM9DS1 for running the driver without
+the chip: benchmarks, tests of the processing and development on a PC.
+
+The simulator is a transport (LSM9DS1_Transport.h) answering register
+reads and writes of the accel/gyro and the magnetometer like the chip.
+The output registers hold the physical quantities given by the model
+quantised at the full scales written to the control registers. The
+FIFO fills at the gyro/accel ODR, honours FIFO mode (stops when full)
+and continuous mode (overwrites and reports OVRN in FIFO_SRC), and pops
+an entry with every read of the accelerometer output registers. The
+status registers always report new data.
+
+Optionally the outputs carry the errors of a real sensor (setNoise()):
+white noise, a bias instability, a bias random walk, a turn-on bias and
+a bias drifting with the temperature. The outputs are quantised at the
+configured scales and saturate at the ends of the 16 bit range like the
+chip's. The temperature is reported in OUT_TEMP.
+
+Time runs with CLOCK_MONOTONIC or, after setManualClock(true), only when
+advance() is called, which makes FIFO fill levels reproducible.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Simulator_H__
+#define __LSM9DS1_Simulator_H__
+
+#include <stdint.h>
+#include "LSM9DS1_Transport.h"
+
+// Error model of one sensor, in its units: dps, g or Gs. The
+// coefficients are the ones of an Allan deviation plot (IEEE 952) or
+// of the datasheet. All zero is a perfect sensor.
+struct LSM9DS1noise
+{
+	// White noise density in units/sqrt(Hz): the Allan deviation at
+	// 1 s on the -1/2 slope ("rate noise density" of the datasheet).
+	float density = 0;
+	// Bias instability in units: the flat minimum of the Allan
+	// deviation divided by 0.664. Modelled as a first order
+	// Gauss-Markov process with the given correlation time in s.
+	float instability = 0;
+	float correlation = 100;
+	// Bias random walk in units*sqrt(Hz): the Allan deviation at 3 s
+	// on the +1/2 slope.
+	float randomWalk = 0;
+	// Standard deviation of the bias drawn per axis at setNoise()
+	// ("zero-rate level" / "zero-g level" / "zero-gauss level").
+	float turnOn = 0;
+	// Bias change per degree C away from 25 C, drawn per axis with
+	// this standard deviation.
+	float temperature = 0;
+};
+
+class LSM9DS1simulator : public LSM9DS1transport {
+public:
+	// The chip answers at these I2C addresses, the defaults of LSM9DS1.
+	LSM9DS1simulator(uint8_t xgAddr = 0x6B, uint8_t mAddr = 0x1E);
+
+	virtual void writeByte(uint8_t address, uint8_t subAddress, uint8_t data);
+	virtual uint8_t readByte(uint8_t address, uint8_t subAddress);
+	virtual uint8_t readBytes(uint8_t address, uint8_t subAddress,
+				  uint8_t* dest, uint8_t count);
+
+	// setManualClock() -- Stops (true) or restarts (false) the real time
+	// clock of the simulation. The manual clock carries on from the
+	// current time. Run begin() with the real clock: its calibration
+	// waits for the FIFO to fill.
+	void setManualClock(bool manual);
+
+	// advance() -- Moves the manual clock on by ns.
+	void advance(uint64_t ns) {
+		manualTime += ns;
+	}
+
+	// now() -- Time of the simulation in ns since it was created.
+	uint64_t now() const;
+
+	// setRest() -- The constant quantities of the default model.
+	// Input:
+	//    - g = angular rate in dps
+	//    - a = acceleration in g
+	//    - m = magnetic field in Gs
+	void setRest(const float g[3], const float a[3], const float m[3]);
+
+	// setNoise() -- Switches the error model on. Turn-on biases and
+	// temperature coefficients are drawn now from the seed.
+	// Input:
+	//    - g, a, m = the models of gyro, accel and mag
+	//    - seed = of the random numbers, the same seed gives the same
+	//      errors at the same read times
+	void setNoise(const LSM9DS1noise& g, const LSM9DS1noise& a,
+		      const LSM9DS1noise& m, uint64_t seed = 1);
+
+	// clearNoise() -- Back to perfect outputs.
+	void clearNoise();
+
+	// setTemperature() -- Temperature of the chip in degrees C.
+	void setTemperature(float celsius) {
+		temperature = celsius;
+	}
+
+protected:
+	uint8_t xgAddress, mAddress;
+	uint8_t xgRegs[128];
+	uint8_t mRegs[128];
+	float restG[3], restA[3], restM[3];
+
+	bool manual = false;
+	uint64_t manualTime = 0;
+	uint64_t epoch;
+
+	// FIFO: sample times of the entries, oldest first, and the full
+	// scales they were converted with, see outputScales()
+	static const unsigned fifoDepth = 32;
+	uint64_t fifo[fifoDepth];
+	uint8_t fifoScales[fifoDepth];
+	unsigned fifoFirst = 0;
+	unsigned fifoLevel = 0;
+	bool fifoOverrun = false;
+	uint64_t fifoTick = 0;		// last ODR tick looked at
+	uint64_t latched = 0;		// time of the outputs read last
+	uint8_t latchedScales = 0;
+
+	// Error model of gyro, accel and mag and its state per axis
+	bool noisy = false;
+	LSM9DS1noise noise[3];
+	float turnOnBias[3][3];
+	float tempCoefficient[3][3];
+	float markov[3][3];		// bias instability
+	float walk[3][3];		// bias random walk
+	uint64_t noiseTime = 0;		// the biases are at this time
+	uint64_t random;		// xorshift state
+	float temperature = 25;
+
+	float gaussian();
+	void addNoise(uint64_t t, float* values[3]);
+	double magODR() const;
+
+	// physical() -- The quantities at time t (ns). The default model
+	// returns the rest values.
+	virtual void physical(uint64_t t, float g[3], float a[3], float m[3]);
+
+	uint64_t odrPeriod() const;
+	bool fifoEnabled() const;
+	void resetFIFO();
+	void updateFIFO();
+	// outputScales() -- FS_G and FS_XL: [0][0][0][0][FS_XL 1:0][FS_G 1:0]
+	uint8_t outputScales() const;
+	void putOutputs(uint64_t t, uint8_t scales);
+	uint8_t readRegister(bool xg, uint8_t reg);
+};
+
+#endif
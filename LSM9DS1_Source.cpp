@@ -0,0 +1,107 @@
+/******************************************************************************
+LSM9DS1_Source.cpp
+Sample dispatch and unit conversion shared by all sample sources.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include "LSM9DS1_Source.h"
+#include "LSM9DS1_Types.h"
+
+float magSensitivity[4] = {0.00014, 0.00029, 0.00043, 0.00058};
+
+float LSM9DS1source::gyroResolution(uint16_t scale)
+{
+    return ((float) scale) / 32768.0;
+}
+
+float LSM9DS1source::accelResolution(uint8_t scale)
+{
+    return ((float) scale) / 32768.0;
+}
+
+float LSM9DS1source::magResolution(uint8_t scale)
+{
+    switch (scale)
+    {
+    case 8:
+        return magSensitivity[1];
+    case 12:
+        return magSensitivity[2];
+    case 16:
+        return magSensitivity[3];
+    default:
+        return magSensitivity[0];
+    }
+}
+
+uint8_t LSM9DS1source::scaleCode(uint16_t gyroScale, uint8_t accelScale, uint8_t magScale)
+{
+    uint8_t g = G_SCALE_245DPS;
+    if (gyroScale == 500) g = G_SCALE_500DPS;
+    if (gyroScale == 2000) g = G_SCALE_2000DPS;
+    uint8_t a = A_SCALE_2G;
+    if (accelScale == 4) a = A_SCALE_4G;
+    if (accelScale == 8) a = A_SCALE_8G;
+    if (accelScale == 16) a = A_SCALE_16G;
+    uint8_t m = M_SCALE_4GS;
+    if (magScale == 8) m = M_SCALE_8GS;
+    if (magScale == 12) m = M_SCALE_12GS;
+    if (magScale == 16) m = M_SCALE_16GS;
+    return g | (a << 2) | (m << 4);
+}
+
+uint16_t LSM9DS1source::gyroScaleOf(uint8_t code)
+{
+    switch (code & 0x3)
+    {
+    case G_SCALE_500DPS:
+        return 500;
+    case G_SCALE_2000DPS:
+        return 2000;
+    default:
+        return 245;
+    }
+}
+
+uint8_t LSM9DS1source::accelScaleOf(uint8_t code)
+{
+    switch ((code >> 2) & 0x3)
+    {
+    case A_SCALE_4G:
+        return 4;
+    case A_SCALE_8G:
+        return 8;
+    case A_SCALE_16G:
+        return 16;
+    default:
+        return 2;
+    }
+}
+
+uint8_t LSM9DS1source::magScaleOf(uint8_t code)
+{
+    return 4 * (((code >> 4) & 0x3) + 1);
+}
+
+void LSM9DS1source::dispatch(const LSM9DS1sample& sample)
+{
+    if (sampleSink) sampleSink->hasSample(sample);
+    if (!lsm9ds1Callback) return;
+    if (sample.scale != sampleResScale) {
+        sampleRes[0] = gyroResolution(gyroScaleOf(sample.scale));
+        sampleRes[1] = accelResolution(accelScaleOf(sample.scale));
+        sampleRes[2] = magResolution(magScaleOf(sample.scale));
+        sampleResScale = sample.scale;
+    }
+    lsm9ds1Callback->hasSample(
+        sampleRes[0] * sample.g[0],
+        sampleRes[0] * sample.g[1],
+        sampleRes[0] * sample.g[2],
+        sampleRes[1] * sample.a[0],
+        sampleRes[1] * sample.a[1],
+        sampleRes[1] * sample.a[2],
+        sampleRes[2] * sample.m[0],
+        sampleRes[2] * sample.m[1],
+        sampleRes[2] * sample.m[2]);
+}
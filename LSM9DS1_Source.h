@@ -0,0 +1,85 @@
+/******************************************************************************
+LSM9DS1_Source.h
+Common base of everything which delivers LSM9DS1 samples.
+
+The live device and the log replay both hand their raw samples to
+dispatch() so that sinks and callbacks see bit-identical data no matter
+where it came from.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Source_H__
+#define __LSM9DS1_Source_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "LSM9DS1_Sample.h"
+
+class LSM9DS1callback {
+public:
+        /**
+         * Called after a sample has arrived.
+         **/
+        virtual void hasSample(float gx,
+			       float gy,
+			       float gz,
+			       float ax,
+			       float ay,
+			       float az,
+			       float mx,
+			       float my,
+			       float mz) = 0;
+};
+
+class LSM9DS1source {
+public:
+	void setCallback(LSM9DS1callback* cb) {
+		lsm9ds1Callback = cb;
+	}
+
+	// setSampleSink() -- Receives the raw, timestamped samples as well,
+	// for example to log them. Called before the callback.
+	void setSampleSink(LSM9DS1sampleSink* sink) {
+		sampleSink = sink;
+	}
+
+	// gyroResolution(), accelResolution(), magResolution() --
+	// Units (DPS, g's or Gs) per ADC tick at the given full scale.
+	static float gyroResolution(uint16_t scale);
+	static float accelResolution(uint8_t scale);
+	static float magResolution(uint8_t scale);
+
+	// scaleCode() -- Packs the full scales (245/500/2000 dps, 2/4/8/16 g,
+	// 4/8/12/16 Gs) into LSM9DS1sample::scale:
+	// [0][0][mag_scale 1:0][accel_scale 1:0][gyro_scale 1:0]
+	static uint8_t scaleCode(uint16_t gyroScale, uint8_t accelScale, uint8_t magScale);
+
+	// gyroScaleOf(), accelScaleOf(), magScaleOf() -- Unpack LSM9DS1sample::scale
+	static uint16_t gyroScaleOf(uint8_t code);
+	static uint8_t accelScaleOf(uint8_t code);
+	static uint8_t magScaleOf(uint8_t code);
+
+protected:
+	LSM9DS1callback* lsm9ds1Callback = NULL;
+	LSM9DS1sampleSink* sampleSink = NULL;
+
+	// gRes, aRes, and mRes store the current resolution for each sensor. 
+	// Units of these values would be DPS (or g's or Gs's) per ADC tick.
+	// This value is calculated as (sensor scale) / (2^15).
+	float gRes, aRes, mRes;
+
+	// dispatch() -- Hands a sample to the sink and, converted with the
+	// resolutions of the scales it was taken with, to the callback.
+	// Samples still pending when the device changes its scale keep
+	// their own conversion.
+	void dispatch(const LSM9DS1sample& sample);
+
+private:
+	// Resolutions of gyro, accel and mag dispatch() converts with, never
+	// the ones of the device, and the scale code they are for
+	float sampleRes[3];
+	uint8_t sampleResScale = 0xff;
+};
+
+#endif
@@ -0,0 +1,203 @@
+/******************************************************************************
+LSM9DS1_Summary.cpp
+Incremental summary pyramid and its reader.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <string.h>
+#include <string>
+#include "LSM9DS1_Summary.h"
+#include "LSM9DS1_Endian.h"
+
+static const uint8_t summaryMagic[4] = {'L', 'S', 'M', 'S'};
+static const uint16_t summaryVersion = 2;
+static const uint64_t nsPerSecond = 1000000000;
+
+const unsigned LSM9DS1summaryWriter::levelSeconds[LSM9DS1summaryWriter::nLevels] =
+    {1, 10, 60, 600, 3600};
+
+static inline void putFloat(uint8_t* p, float v)
+{
+    uint32_t u;
+    memcpy(&u, &v, 4);
+    put32(p, u);
+}
+
+static inline float getFloat(const uint8_t* p)
+{
+    const uint32_t u = get32(p);
+    float v;
+    memcpy(&v, &u, 4);
+    return v;
+}
+
+static std::string summaryFilename(const char* logFilename, unsigned seconds)
+{
+    return std::string(logFilename) + ".sum" + std::to_string(seconds);
+}
+
+
+LSM9DS1summaryWriter::LSM9DS1summaryWriter(const char* logFilename)
+{
+    for (unsigned l = 0; l < nLevels; l++) {
+        files[l] = fopen(summaryFilename(logFilename, levelSeconds[l]).c_str(), "wb");
+        if (!files[l]) {
+            while (l > 0) fclose(files[--l]);
+            throw "Could not open summary file for writing.";
+        }
+        // [magic 4][version 2][reserved 2][bin width in s 4]
+        uint8_t h[headerSize];
+        memset(h, 0, sizeof(h));
+        memcpy(h, summaryMagic, 4);
+        put16(h + 4, summaryVersion);
+        put32(h + 8, levelSeconds[l]);
+        fwrite(h, 1, sizeof(h), files[l]);
+        bins[l].count = 0;
+    }
+}
+
+LSM9DS1summaryWriter::~LSM9DS1summaryWriter()
+{
+    // The open bins cascade upwards so that close() has to go bottom up.
+    for (unsigned l = 0; l < nLevels; l++) {
+        close(l);
+        fclose(files[l]);
+    }
+}
+
+void LSM9DS1summaryWriter::hasSample(const LSM9DS1sample& sample)
+{
+    if (sample.scale != scale) {
+        scale = sample.scale;
+        res[0] = LSM9DS1source::gyroResolution(LSM9DS1source::gyroScaleOf(scale));
+        res[1] = LSM9DS1source::accelResolution(LSM9DS1source::accelScaleOf(scale));
+        res[2] = LSM9DS1source::magResolution(LSM9DS1source::magScaleOf(scale));
+    }
+    Bin b;
+    b.index = sample.timestamp / nsPerSecond;
+    b.count = 1;
+    float c[LSM9DS1_SUMMARY_CHANNELS];
+    for (int i = 0; i < 3; i++) {
+        c[i] = res[0] * sample.g[i];
+        c[i + 3] = res[1] * sample.a[i];
+        c[i + 6] = res[2] * sample.m[i];
+    }
+    for (int i = 0; i < LSM9DS1_SUMMARY_CHANNELS; i++) {
+        b.min[i] = b.max[i] = c[i];
+        b.sum[i] = c[i];
+    }
+    merge(0, b);
+}
+
+void LSM9DS1summaryWriter::flush()
+{
+    for (unsigned l = 0; l < nLevels; l++) fflush(files[l]);
+}
+
+// Adds a bin of the level below (or a single sample for level 0) to the
+// open bin of the level. If it belongs to a later bin the open one is
+// closed first.
+void LSM9DS1summaryWriter::merge(unsigned level, const Bin& in)
+{
+    const uint64_t index = in.index / (levelSeconds[level] / (level ? levelSeconds[level - 1] : 1));
+    Bin& b = bins[level];
+    if (b.count && (b.index != index)) close(level);
+    if (!b.count) {
+        b = in;
+        b.index = index;
+        return;
+    }
+    b.count += in.count;
+    for (int i = 0; i < LSM9DS1_SUMMARY_CHANNELS; i++) {
+        if (in.min[i] < b.min[i]) b.min[i] = in.min[i];
+        if (in.max[i] > b.max[i]) b.max[i] = in.max[i];
+        b.sum[i] += in.sum[i];
+    }
+}
+
+void LSM9DS1summaryWriter::close(unsigned level)
+{
+    Bin& b = bins[level];
+    if (!b.count) return;
+    // [timestamp 8][count 4][min 9*4][max 9*4][mean 9*4], floats
+    uint8_t r[recordSize];
+    put64(r, b.index * levelSeconds[level] * nsPerSecond);
+    put32(r + 8, b.count);
+    for (int i = 0; i < LSM9DS1_SUMMARY_CHANNELS; i++) {
+        const float mean = (float)(b.sum[i] / b.count);
+        putFloat(r + 12 + 4 * i, b.min[i]);
+        putFloat(r + 48 + 4 * i, b.max[i]);
+        putFloat(r + 84 + 4 * i, mean);
+    }
+    fwrite(r, 1, sizeof(r), files[level]);
+    if (level + 1 < nLevels) merge(level + 1, b);
+    b.count = 0;
+}
+
+LSM9DS1summaryReader::LSM9DS1summaryReader(const char* logFilename, unsigned seconds)
+{
+    file = fopen(summaryFilename(logFilename, seconds).c_str(), "rb");
+    if (!file)
+        throw "Could not open summary file.";
+    uint8_t h[LSM9DS1summaryWriter::headerSize];
+    if ((fread(h, 1, sizeof(h), file) != sizeof(h)) ||
+        (memcmp(h, summaryMagic, 4) != 0) || (get16(h + 4) != summaryVersion)) {
+        fclose(file);
+        throw "Not an LSM9DS1 summary file.";
+    }
+    width = (uint64_t)get32(h + 8) * nsPerSecond;
+    fseek(file, 0, SEEK_END);
+    nRecords = (ftell(file) - LSM9DS1summaryWriter::headerSize) / LSM9DS1summaryWriter::recordSize;
+}
+
+LSM9DS1summaryReader::~LSM9DS1summaryReader()
+{
+    fclose(file);
+}
+
+unsigned LSM9DS1summaryReader::coarsestLevel(uint64_t from, uint64_t to, unsigned maxPoints)
+{
+    const uint64_t span = (to > from) ? (to - from) : 0;
+    unsigned seconds = LSM9DS1summaryWriter::levelSeconds[0];
+    for (unsigned l = 0; l < LSM9DS1summaryWriter::nLevels; l++) {
+        if (span / (LSM9DS1summaryWriter::levelSeconds[l] * nsPerSecond) < maxPoints) break;
+        seconds = LSM9DS1summaryWriter::levelSeconds[l];
+    }
+    return seconds;
+}
+
+bool LSM9DS1summaryReader::readRecord(size_t i, LSM9DS1summary& s)
+{
+    uint8_t r[LSM9DS1summaryWriter::recordSize];
+    fseek(file, LSM9DS1summaryWriter::headerSize + i * sizeof(r), SEEK_SET);
+    if (fread(r, 1, sizeof(r), file) != sizeof(r)) return false;
+    s.timestamp = get64(r);
+    s.count = get32(r + 8);
+    for (int c = 0; c < LSM9DS1_SUMMARY_CHANNELS; c++) {
+        s.min[c] = getFloat(r + 12 + 4 * c);
+        s.max[c] = getFloat(r + 48 + 4 * c);
+        s.mean[c] = getFloat(r + 84 + 4 * c);
+    }
+    return true;
+}
+
+size_t LSM9DS1summaryReader::read(uint64_t from, uint64_t to, std::vector<LSM9DS1summary>& out)
+{
+    // First bin which ends after from
+    const uint64_t first = from - (from % width);
+    size_t lo = 0, hi = nRecords;
+    LSM9DS1summary s;
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (!readRecord(mid, s)) return 0;
+        if (s.timestamp < first) lo = mid + 1;
+        else hi = mid;
+    }
+    size_t n = 0;
+    for (size_t i = lo; (i < nRecords) && readRecord(i, s) && (s.timestamp <= to); i++) {
+        out.push_back(s);
+        n++;
+    }
+    return n;
+}
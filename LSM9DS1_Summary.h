@@ -0,0 +1,98 @@
+/******************************************************************************
+LSM9DS1_Summary.h
+Multi-resolution min/max/mean summaries of LSM9DS1 logs.
+
+While a log is written the writer also bins the samples into 1 s, 10 s,
+1 min, 10 min and 1 h summaries of every channel and stores each level in
+its own file "<log>.sum<seconds>" next to the log. Bins are aligned to
+multiples of their width so every level is built from the one below it
+without rereading raw data. A week at 10 min resolution is about 85 kB.
+
+Records have a fixed size and are sorted by time, so a reader can
+binary-search them. Values are in physical units (dps, g, Gs), each
+sample converted with the scales it was taken with, so bins stay valid
+across scale changes of the auto-ranging or of commands.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Summary_H__
+#define __LSM9DS1_Summary_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "LSM9DS1_Source.h"
+
+// Channels in the order gyro x, y, z, accel x, y, z, mag x, y, z
+#define LSM9DS1_SUMMARY_CHANNELS 9
+
+struct LSM9DS1summary
+{
+	uint64_t timestamp;	// start of the bin in ns
+	uint32_t count;		// number of samples in the bin
+	float min[LSM9DS1_SUMMARY_CHANNELS];	// dps, g, Gs
+	float max[LSM9DS1_SUMMARY_CHANNELS];
+	float mean[LSM9DS1_SUMMARY_CHANNELS];
+};
+
+class LSM9DS1summaryWriter : public LSM9DS1sampleSink {
+public:
+	// Width of the levels of the pyramid in seconds.
+	static const unsigned nLevels = 5;
+	static const unsigned levelSeconds[nLevels];
+
+	// Size of a summary file header and record on disk.
+	static const size_t headerSize = 12;
+	static const size_t recordSize = 120;
+
+	// Creates or truncates the summary files of the log.
+	LSM9DS1summaryWriter(const char* logFilename);
+	// Writes the bins which are still open and closes the files.
+	~LSM9DS1summaryWriter();
+
+	virtual void hasSample(const LSM9DS1sample& sample);
+
+	// Flushes the completed bins to disk.
+	void flush();
+
+protected:
+	struct Bin {
+		uint64_t index;	// timestamp / width
+		uint32_t count;
+		float min[LSM9DS1_SUMMARY_CHANNELS];
+		float max[LSM9DS1_SUMMARY_CHANNELS];
+		double sum[LSM9DS1_SUMMARY_CHANNELS];
+	};
+	FILE* files[nLevels];
+	Bin bins[nLevels];
+	// Scale code of the last sample and its resolutions
+	uint8_t scale = 0xff;
+	float res[3];
+	void merge(unsigned level, const Bin& bin);
+	void close(unsigned level);
+};
+
+class LSM9DS1summaryReader {
+public:
+	// Opens the summary level of the log with the given bin width.
+	// Throws if it doesn't exist.
+	LSM9DS1summaryReader(const char* logFilename, unsigned seconds);
+	~LSM9DS1summaryReader();
+
+	// coarsestLevel() -- Width of the coarsest level which still has
+	// at least maxPoints bins between from and to.
+	static unsigned coarsestLevel(uint64_t from, uint64_t to, unsigned maxPoints);
+
+	// read() -- Appends the bins overlapping [from, to] to out.
+	// Output: number of bins appended.
+	size_t read(uint64_t from, uint64_t to, std::vector<LSM9DS1summary>& out);
+
+protected:
+	FILE* file;
+	uint64_t width;
+	size_t nRecords;
+	bool readRecord(size_t i, LSM9DS1summary& summary);
+};
+
+#endif
@@ -0,0 +1,152 @@
+/******************************************************************************
+LSM9DS1_Trace.cpp
+Per-thread event rings and the Chrome trace JSON writer.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <time.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <mutex>
+#include "LSM9DS1_Trace.h"
+
+struct TraceEvent
+{
+    // 0 while being written, otherwise the event's number + 1
+    std::atomic<uint64_t> seq;
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+};
+
+struct TraceRing
+{
+    const char* threadName;
+    unsigned tid;
+    uint64_t capacity;
+    TraceEvent* events;
+    std::atomic<uint64_t> head;	// events recorded so far
+};
+
+std::atomic<bool> LSM9DS1tracer::enabled(false);
+std::atomic<unsigned long> LSM9DS1tracer::lost(0);
+
+static TraceRing* rings[LSM9DS1tracer::maxThreads];
+static std::atomic<unsigned> nRings(0);
+static std::mutex registerMutex;
+static __thread TraceRing* threadRing = NULL;
+
+uint64_t LSM9DS1tracer::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void LSM9DS1tracer::registerThread(const char* name, unsigned capacity)
+{
+    if (threadRing) {
+        threadRing->threadName = name;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(registerMutex);
+    const unsigned n = nRings.load(std::memory_order_relaxed);
+    if (n >= maxThreads) throw "Too many threads for the tracer.";
+    TraceRing* ring = new TraceRing;
+    ring->threadName = name;
+    ring->tid = n + 1;
+    ring->capacity = capacity ? capacity : 1;
+    ring->events = new TraceEvent[ring->capacity];
+    for (uint64_t i = 0; i < ring->capacity; i++) ring->events[i].seq.store(0);
+    ring->head.store(0);
+    // Rings are never freed: the writer may look at them any time
+    rings[n] = ring;
+    nRings.store(n + 1, std::memory_order_release);
+    threadRing = ring;
+}
+
+void LSM9DS1tracer::enable(bool on)
+{
+    enabled.store(on, std::memory_order_relaxed);
+}
+
+// Runs in the acquisition context: no locks, no allocation and only
+// async-signal-safe calls.
+void LSM9DS1tracer::record(const char* name, uint64_t start, uint64_t duration)
+{
+    TraceRing* ring = threadRing;
+    if (!ring) {
+        lost.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // The claim is atomic as a signal handler may record in between
+    const uint64_t i = ring->head.fetch_add(1, std::memory_order_relaxed);
+    TraceEvent& e = ring->events[i % ring->capacity];
+    e.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    e.name = name;
+    e.start = start;
+    e.duration = duration;
+    e.seq.store(i + 1, std::memory_order_release);
+}
+
+void LSM9DS1tracer::clear()
+{
+    const unsigned n = nRings.load(std::memory_order_acquire);
+    for (unsigned r = 0; r < n; r++) {
+        TraceRing* ring = rings[r];
+        for (uint64_t i = 0; i < ring->capacity; i++)
+            ring->events[i].seq.store(0, std::memory_order_relaxed);
+    }
+}
+
+// Escapes a string for JSON
+static void putString(FILE* f, const char* s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        if ((*s == '"') || (*s == '\\')) fputc('\\', f);
+        if ((unsigned char)*s < 0x20) continue;
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+void LSM9DS1tracer::write(const char* filename)
+{
+    FILE* f = fopen(filename, "w");
+    if (!f) throw "Could not write the trace file.";
+    const int pid = getpid();
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first = true;
+    const unsigned n = nRings.load(std::memory_order_acquire);
+    for (unsigned r = 0; r < n; r++) {
+        const TraceRing* ring = rings[r];
+        fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%u,"
+                "\"args\":{\"name\":", first ? "" : ",\n", pid, ring->tid);
+        putString(f, ring->threadName);
+        fprintf(f, "}}");
+        first = false;
+        const uint64_t head = ring->head.load(std::memory_order_acquire);
+        const uint64_t from = head > ring->capacity ? head - ring->capacity : 0;
+        for (uint64_t i = from; i < head; i++) {
+            const TraceEvent& e = ring->events[i % ring->capacity];
+            // Skip slots which are being rewritten while we look
+            if (e.seq.load(std::memory_order_acquire) != i + 1) continue;
+            const char* name = e.name;
+            const uint64_t start = e.start;
+            const uint64_t duration = e.duration;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (e.seq.load(std::memory_order_relaxed) != i + 1) continue;
+            fprintf(f, ",\n{\"ph\":\"X\",\"cat\":\"lsm9ds1\",\"name\":");
+            putString(f, name);
+            fprintf(f, ",\"pid\":%d,\"tid\":%u,\"ts\":%llu.%03u,\"dur\":%llu.%03u}",
+                    pid, ring->tid,
+                    (unsigned long long)(start / 1000), (unsigned)(start % 1000),
+                    (unsigned long long)(duration / 1000), (unsigned)(duration % 1000));
+        }
+    }
+    fprintf(f, "\n]}\n");
+    if (fclose(f) != 0) throw "Could not write the trace file.";
+}
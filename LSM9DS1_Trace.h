@@ -0,0 +1,99 @@
+/******************************************************************************
+LSM9DS1_Trace.h
+Event tracer which writes the Chrome trace format (chrome://tracing,
+ui.perfetto.dev).
+
+Each thread records its events into a ring of its own, so recording takes
+no lock: a slot is claimed with an atomic increment, which also makes it
+safe in the timer's signal handler interrupting the same thread. When the
+ring is full the oldest events are overwritten, so after a jitter spike
+the last moments are there to be written out.
+
+Threads register once, before they record (registerThread() allocates
+their ring). Events of threads which aren't registered are counted as
+lost. The timer's signal is delivered to any thread of the process which
+doesn't block it, so register all of them or block SIGRTMIN in the ones
+which aren't.
+
+The library records timerEvent(), every I2C read and the stages shipped
+with it only when built with cmake -DLSM9DS1_TRACE=ON. Own code can
+always record with LSM9DS1traceScope.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Trace_H__
+#define __LSM9DS1_Trace_H__
+
+#include <stdint.h>
+#include <atomic>
+
+class LSM9DS1tracer {
+public:
+	// Maximum number of threads which can register
+	static const unsigned maxThreads = 32;
+
+	// registerThread() -- Allocates the ring of the calling thread.
+	// Calling it again only renames the thread.
+	// Input:
+	//    - name = shown in the trace, has to stay valid
+	//    - capacity = events kept for this thread
+	static void registerThread(const char* name, unsigned capacity = 16384);
+
+	// enable() -- Starts or stops recording. Off at the start.
+	static void enable(bool on = true);
+
+	static bool isEnabled() {
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	// record() -- Records an event of the calling thread.
+	// Input:
+	//    - name = name of the event, has to stay valid (a string literal)
+	//    - start = CLOCK_MONOTONIC in ns
+	//    - duration = in ns
+	static void record(const char* name, uint64_t start, uint64_t duration);
+
+	// write() -- Writes the events in the rings as Chrome trace JSON.
+	// Can be called while recording.
+	static void write(const char* filename);
+
+	// clear() -- Forgets the recorded events.
+	static void clear();
+
+	// Events lost because their thread wasn't registered
+	static unsigned long getLost() {
+		return lost.load(std::memory_order_relaxed);
+	}
+
+	// now() -- CLOCK_MONOTONIC in ns
+	static uint64_t now();
+
+protected:
+	static std::atomic<bool> enabled;
+	static std::atomic<unsigned long> lost;
+};
+
+// Records the time from its creation to the end of its scope as one event.
+class LSM9DS1traceScope {
+public:
+	LSM9DS1traceScope(const char* name) : name(name) {
+		start = LSM9DS1tracer::isEnabled() ? LSM9DS1tracer::now() : 0;
+	}
+	~LSM9DS1traceScope() {
+		if (start) LSM9DS1tracer::record(name, start, LSM9DS1tracer::now() - start);
+	}
+
+private:
+	const char* name;
+	uint64_t start;
+};
+
+// Traces the rest of the scope in the library's own code.
+#ifdef LSM9DS1_TRACE
+#define LSM9DS1_TRACE_SCOPE(name) LSM9DS1traceScope traceScope(name)
+#else
+#define LSM9DS1_TRACE_SCOPE(name)
+#endif
+
+#endif
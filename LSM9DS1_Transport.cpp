@@ -0,0 +1,63 @@
+/******************************************************************************
+LSM9DS1_Transport.cpp
+I2C register access through wiringPi.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <wiringPiI2C.h>
+#include "LSM9DS1_Transport.h"
+
+// Wire.h read and write protocols
+void LSM9DS1i2cTransport::writeByte(uint8_t address, uint8_t subAddress, uint8_t data)
+{
+    _fd = wiringPiI2CSetup(address);
+    if (_fd < 0) {
+        fprintf(stderr, "Error: I2CSetup failed\n");
+        exit(EXIT_FAILURE);
+    }
+    wiringPiI2CWriteReg8(_fd, subAddress, data);
+    close(_fd);
+    // open, ioctl(I2C_SLAVE), ioctl(I2C_SMBUS), close
+    estimatedSyscalls.fetch_add(4, std::memory_order_relaxed);
+}
+
+uint8_t LSM9DS1i2cTransport::readByte(uint8_t address, uint8_t subAddress)
+{
+    _fd = wiringPiI2CSetup(address);
+    if (_fd < 0) {
+        fprintf(stderr, "Error: I2CSetup failed\n");
+        exit(EXIT_FAILURE);
+    }
+    uint8_t data; // `data` will store the register data
+    wiringPiI2CWrite(_fd, subAddress);
+    data = wiringPiI2CRead(_fd);                // Fill Rx buffer with result
+    close(_fd);
+    // open, ioctl(I2C_SLAVE), 2 x ioctl(I2C_SMBUS), close
+    estimatedSyscalls.fetch_add(5, std::memory_order_relaxed);
+    return data;                             // Return data read from slave register
+}
+
+uint8_t LSM9DS1i2cTransport::readBytes(uint8_t address, uint8_t subAddress, uint8_t * dest, uint8_t count)
+{
+    _fd = wiringPiI2CSetup(address);
+    if (_fd < 0) {
+        fprintf(stderr, "Error: I2C Setup\n");
+        exit(EXIT_FAILURE);
+    }
+    wiringPiI2CWrite(_fd, subAddress);
+    // open, ioctl(I2C_SLAVE), ioctl(I2C_SMBUS), read, close
+    estimatedSyscalls.fetch_add(5, std::memory_order_relaxed);
+    // Straight into the destination
+    if ((read(_fd, dest, count)) < 0) {
+        //fprintf(stderr, "Error: read value\n");
+        close(_fd);
+        throw 999;
+        return 0;
+    }
+    close(_fd);
+    return count;
+}
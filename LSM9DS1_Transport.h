@@ -0,0 +1,91 @@
+/******************************************************************************
+LSM9DS1_Transport.h
+Register access to the LSM9DS1, so that the driver can talk to the chip
+on the I2C bus or to a simulation of it (LSM9DS1_Simulator.h).
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_Transport_H__
+#define __LSM9DS1_Transport_H__
+
+#include <stdint.h>
+#include <atomic>
+
+class LSM9DS1transport {
+public:
+	// writeByte() -- Writes a byte to a register of the device.
+	// Input:
+	//    - address = The 7-bit I2C address of the device.
+	//    - subAddress = The register to be written to.
+	//    - data = Byte to be written to the register.
+	virtual void writeByte(uint8_t address, uint8_t subAddress, uint8_t data) = 0;
+
+	// readByte() -- Reads a single register.
+	// Output: the byte read.
+	virtual uint8_t readByte(uint8_t address, uint8_t subAddress) = 0;
+
+	// readBytes() -- Reads count consecutive registers into dest.
+	// A failed read throws an int.
+	// Output: number of bytes read.
+	virtual uint8_t readBytes(uint8_t address, uint8_t subAddress,
+				  uint8_t* dest, uint8_t count) = 0;
+
+	// getEstimatedSyscalls() -- System calls made so far, if the transport
+	// knows them. An estimate from the calls a transfer is known to make,
+	// not measured.
+	virtual unsigned long getEstimatedSyscalls() const {
+		return 0;
+	}
+
+	// beginOperation() / endOperation() -- The driver marks which of its
+	// operations the following transfers belong to. Operations can nest:
+	// endOperation() gets what beginOperation() returned.
+	// Input:
+	//    - name = name of the operation, has to stay valid (a string literal)
+	virtual const char* beginOperation(const char* name) {
+		return name;
+	}
+	virtual void endOperation(const char* /* previous */) {
+	}
+
+	virtual ~LSM9DS1transport() {}
+};
+
+// Marks the transfers until the end of the scope as part of an operation.
+class LSM9DS1transportOperation {
+public:
+	LSM9DS1transportOperation(LSM9DS1transport* transport, const char* name)
+		: transport(transport) {
+		previous = transport->beginOperation(name);
+	}
+	~LSM9DS1transportOperation() {
+		transport->endOperation(previous);
+	}
+
+private:
+	LSM9DS1transport* transport;
+	const char* previous;
+};
+
+// The I2C bus of the Raspberry PI through wiringPi.
+class LSM9DS1i2cTransport : public LSM9DS1transport {
+public:
+	virtual void writeByte(uint8_t address, uint8_t subAddress, uint8_t data);
+	virtual uint8_t readByte(uint8_t address, uint8_t subAddress);
+	virtual uint8_t readBytes(uint8_t address, uint8_t subAddress,
+				  uint8_t* dest, uint8_t count);
+
+	// The system calls wiringPi makes per transfer, see
+	// LSM9DS1_Transport.cpp.
+	virtual unsigned long getEstimatedSyscalls() const {
+		return estimatedSyscalls;
+	}
+
+protected:
+	// File descriptor
+	int _fd;
+	std::atomic<unsigned long> estimatedSyscalls{0};
+};
+
+#endif
@@ -0,0 +1,181 @@
+/******************************************************************************
+LSM9DS1_TransportCounter.cpp
+Counting of operations and transfers and their report.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include "LSM9DS1_TransportCounter.h"
+
+static inline uint64_t monotonic()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+LSM9DS1countingTransport::LSM9DS1countingTransport(LSM9DS1transport& transport, bool timed)
+    : transport(transport), timed(timed)
+{
+    for (unsigned i = 0; i < maxOperations; i++) names[i].store(NULL);
+    names[maxOperations].store("other");
+    current.store(&operations[maxOperations]);
+    addresses[0].store(0);
+    addresses[1].store(0);
+}
+
+// Registers a new name in a slot of its own, so that the driver's thread
+// and the signal handler can both do it. If both register the same name
+// at once it gets two slots; getCounts() and report() only look at the
+// first one.
+LSM9DS1countingTransport::Counts* LSM9DS1countingTransport::operationCounts(const char* name)
+{
+    if (name == names[maxOperations].load(std::memory_order_relaxed))
+        return &operations[maxOperations];
+    unsigned n = nOperations.load(std::memory_order_acquire);
+    if (n > maxOperations) n = maxOperations;
+    for (unsigned i = 0; i < n; i++) {
+        const char* s = names[i].load(std::memory_order_acquire);
+        if (s && ((s == name) || (strcmp(s, name) == 0))) return &operations[i];
+    }
+    const unsigned slot = nOperations.fetch_add(1, std::memory_order_acq_rel);
+    if (slot >= maxOperations) return &operations[maxOperations];
+    names[slot].store(name, std::memory_order_release);
+    return &operations[slot];
+}
+
+const char* LSM9DS1countingTransport::beginOperation(const char* name)
+{
+    Counts* c = operationCounts(name);
+    c->runs.fetch_add(1, std::memory_order_relaxed);
+    Counts* previous = current.exchange(c, std::memory_order_relaxed);
+    return names[previous - operations].load(std::memory_order_acquire);
+}
+
+void LSM9DS1countingTransport::endOperation(const char* previous)
+{
+    current.store(operationCounts(previous), std::memory_order_relaxed);
+}
+
+void LSM9DS1countingTransport::count(uint8_t address, uint8_t subAddress, unsigned bytes,
+                                     unsigned long estimatedSyscalls, uint64_t ns)
+{
+    Counts* c = current.load(std::memory_order_relaxed);
+    c->estimatedSyscalls.fetch_add(estimatedSyscalls, std::memory_order_relaxed);
+    c->transactions.fetch_add(1, std::memory_order_relaxed);
+    c->bytes.fetch_add(bytes, std::memory_order_relaxed);
+    c->ns.fetch_add(ns, std::memory_order_relaxed);
+
+    // The first two device addresses seen, claimed once
+    int d;
+    for (d = 0; d < 2; d++) {
+        uint8_t a = addresses[d].load(std::memory_order_relaxed);
+        if (a == address) break;
+        if (!a && (addresses[d].compare_exchange_strong(a, address) || (a == address))) break;
+    }
+    if (d == 2) return;
+    Counts& r = registers[d][subAddress & 0x7F];
+    r.estimatedSyscalls.fetch_add(estimatedSyscalls, std::memory_order_relaxed);
+    r.transactions.fetch_add(1, std::memory_order_relaxed);
+    r.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    r.ns.fetch_add(ns, std::memory_order_relaxed);
+}
+
+void LSM9DS1countingTransport::writeByte(uint8_t address, uint8_t subAddress, uint8_t data)
+{
+    const unsigned long s0 = transport.getEstimatedSyscalls();
+    const uint64_t t0 = timed ? monotonic() : 0;
+    transport.writeByte(address, subAddress, data);
+    count(address, subAddress, 1, transport.getEstimatedSyscalls() - s0,
+          timed ? monotonic() - t0 : 0);
+}
+
+uint8_t LSM9DS1countingTransport::readByte(uint8_t address, uint8_t subAddress)
+{
+    const unsigned long s0 = transport.getEstimatedSyscalls();
+    const uint64_t t0 = timed ? monotonic() : 0;
+    const uint8_t data = transport.readByte(address, subAddress);
+    count(address, subAddress, 1, transport.getEstimatedSyscalls() - s0,
+          timed ? monotonic() - t0 : 0);
+    return data;
+}
+
+uint8_t LSM9DS1countingTransport::readBytes(uint8_t address, uint8_t subAddress,
+                                            uint8_t* dest, uint8_t count)
+{
+    const unsigned long s0 = transport.getEstimatedSyscalls();
+    const uint64_t t0 = timed ? monotonic() : 0;
+    const uint8_t n = transport.readBytes(address, subAddress, dest, count);
+    this->count(address, subAddress, n, transport.getEstimatedSyscalls() - s0,
+                timed ? monotonic() - t0 : 0);
+    return n;
+}
+
+const LSM9DS1countingTransport::Counts* LSM9DS1countingTransport::getCounts(const char* operation) const
+{
+    unsigned n = nOperations.load(std::memory_order_acquire);
+    if (n > maxOperations) n = maxOperations;
+    for (unsigned i = 0; i < n; i++) {
+        const char* s = names[i].load(std::memory_order_acquire);
+        if (s && (strcmp(s, operation) == 0)) return &operations[i];
+    }
+    if (strcmp(operation, "other") == 0) return &operations[maxOperations];
+    return NULL;
+}
+
+std::string LSM9DS1countingTransport::report() const
+{
+    std::string text;
+    char line[160];
+    for (unsigned i = 0; i <= maxOperations; i++) {
+        const char* name = names[i].load(std::memory_order_acquire);
+        if (!name) continue;
+        const Counts& c = operations[i];
+        const unsigned long transactions = c.transactions.load(std::memory_order_relaxed);
+        if (!transactions) continue;
+        unsigned long runs = c.runs.load(std::memory_order_relaxed);
+        if (!runs) runs = 1;
+        snprintf(line, sizeof(line),
+                 "%s: %lu runs, %.1f est. syscalls / %.1f transactions / %.1f bytes / %.1f us per run\n",
+                 name, runs,
+                 (double)c.estimatedSyscalls.load(std::memory_order_relaxed) / runs,
+                 (double)transactions / runs,
+                 (double)c.bytes.load(std::memory_order_relaxed) / runs,
+                 c.ns.load(std::memory_order_relaxed) / 1e3 / runs);
+        text += line;
+    }
+    for (int d = 0; d < 2; d++) {
+        for (int r = 0; r < 128; r++) {
+            const Counts& c = registers[d][r];
+            const unsigned long transactions = c.transactions.load(std::memory_order_relaxed);
+            if (!transactions) continue;
+            snprintf(line, sizeof(line),
+                     "0x%02x/0x%02x: %lu transactions, %lu est. syscalls, %lu bytes, %.1f us\n",
+                     addresses[d].load(std::memory_order_relaxed), r, transactions,
+                     c.estimatedSyscalls.load(std::memory_order_relaxed),
+                     c.bytes.load(std::memory_order_relaxed),
+                     c.ns.load(std::memory_order_relaxed) / 1e3);
+            text += line;
+        }
+    }
+    return text;
+}
+
+static void clear(LSM9DS1countingTransport::Counts& c)
+{
+    c.runs.store(0, std::memory_order_relaxed);
+    c.estimatedSyscalls.store(0, std::memory_order_relaxed);
+    c.transactions.store(0, std::memory_order_relaxed);
+    c.bytes.store(0, std::memory_order_relaxed);
+    c.ns.store(0, std::memory_order_relaxed);
+}
+
+void LSM9DS1countingTransport::reset()
+{
+    for (unsigned i = 0; i <= maxOperations; i++) clear(operations[i]);
+    for (int d = 0; d < 2; d++)
+        for (int r = 0; r < 128; r++) clear(registers[d][r]);
+}
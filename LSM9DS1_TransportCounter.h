@@ -0,0 +1,86 @@
+/******************************************************************************
+LSM9DS1_TransportCounter.h
+Transport decorator which counts the work done on the bus.
+
+Wrapped around any transport it counts for each operation of the driver
+(timerEvent, begin, ...) how often it ran and the estimated system
+calls, bus transactions, bytes and time it took, and for each register
+the transactions, bytes and time of the transfers starting there.
+report() turns that into lines such as
+
+    timerEvent: 1000 runs, 15.0 est. syscalls / 3.0 transactions / 18.0 bytes / 412.3 us per run
+
+so that changes to the bus access can be judged by numbers. The system
+calls are the estimate of the wrapped transport (getEstimatedSyscalls()),
+not a measurement. Counting is a few relaxed atomic additions and, if
+timed, two clock reads per transfer, which is small against an I2C
+transfer. The driver's thread
+and the timer's signal handler may both be in an operation: the state
+shared between them is atomic.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_TransportCounter_H__
+#define __LSM9DS1_TransportCounter_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include "LSM9DS1_Transport.h"
+
+class LSM9DS1countingTransport : public LSM9DS1transport {
+public:
+	// Maximum number of distinct operations, further ones count as "other"
+	static const unsigned maxOperations = 16;
+
+	// Input:
+	//    - transport = the transport doing the transfers
+	//    - timed = also measure the time of each transfer
+	LSM9DS1countingTransport(LSM9DS1transport& transport, bool timed = true);
+
+	virtual void writeByte(uint8_t address, uint8_t subAddress, uint8_t data);
+	virtual uint8_t readByte(uint8_t address, uint8_t subAddress);
+	virtual uint8_t readBytes(uint8_t address, uint8_t subAddress,
+				  uint8_t* dest, uint8_t count);
+	virtual unsigned long getEstimatedSyscalls() const {
+		return transport.getEstimatedSyscalls();
+	}
+	virtual const char* beginOperation(const char* name);
+	virtual void endOperation(const char* previous);
+
+	// report() -- One line per operation, then one per register.
+	std::string report() const;
+
+	// reset() -- Sets all counts back to zero.
+	void reset();
+
+	struct Counts {
+		std::atomic<unsigned long> runs{0};
+		std::atomic<unsigned long> estimatedSyscalls{0};
+		std::atomic<unsigned long> transactions{0};
+		std::atomic<unsigned long> bytes{0};
+		std::atomic<uint64_t> ns{0};
+	};
+
+	// getCounts() -- The counts of an operation, NULL if it never ran.
+	const Counts* getCounts(const char* operation) const;
+
+protected:
+	LSM9DS1transport& transport;
+	bool timed;
+	// Operations, the last one is "other". Slots are claimed by
+	// incrementing nOperations, a NULL name is still being filled in.
+	std::atomic<const char*> names[maxOperations + 1];
+	Counts operations[maxOperations + 1];
+	std::atomic<unsigned> nOperations{0};
+	std::atomic<Counts*> current;
+	// Per register of the two devices, by the address of the first one
+	std::atomic<uint8_t> addresses[2];
+	Counts registers[2][128];
+	Counts* operationCounts(const char* name);
+	void count(uint8_t address, uint8_t subAddress, unsigned bytes,
+		   unsigned long estimatedSyscalls, uint64_t ns);
+};
+
+#endif
@@ -165,6 +165,14 @@ enum pp_od
 	INT_OPEN_DRAIN
 };
 
+// burst_trigger defines the events which start a burst capture:
+enum burst_trigger
+{
+	BURST_ON_ACCEL_INT = (1<<0),	// accel interrupt generator (IG_XL)
+	BURST_ON_GYRO_INT = (1<<1),	// gyro interrupt generator (IG_G)
+	BURST_ON_ACTIVITY = (1<<2)	// activity, see configInactivity()
+};
+
 enum fifoMode_type
 {
 	FIFO_OFF = 0,
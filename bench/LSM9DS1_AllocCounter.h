@@ -0,0 +1,41 @@
+/******************************************************************************
+LSM9DS1_AllocCounter.h
+Counts the allocations of the whole process, the library included, while
+armed. It replaces malloc(), calloc() and realloc() of glibc, so it is
+included by one source file of a program only.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#ifndef __LSM9DS1_AllocCounter_H__
+#define __LSM9DS1_AllocCounter_H__
+
+#include <stdlib.h>
+#include <atomic>
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t n, size_t size);
+extern "C" void* __libc_realloc(void* p, size_t size);
+
+static std::atomic<bool> armed{false};
+static std::atomic<unsigned long> allocations{0};
+
+extern "C" void* malloc(size_t size)
+{
+	if (armed.load(std::memory_order_relaxed)) allocations++;
+	return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t n, size_t size)
+{
+	if (armed.load(std::memory_order_relaxed)) allocations++;
+	return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* p, size_t size)
+{
+	if (armed.load(std::memory_order_relaxed)) allocations++;
+	return __libc_realloc(p, size);
+}
+
+#endif
@@ -0,0 +1,340 @@
+/******************************************************************************
+LSM9DS1_bench.cpp
+Benchmarks of the acquisition and processing paths, run against the
+simulated chip so that they need no hardware and are repeatable.
+
+Prints one JSON object per benchmark and line:
+    {"name":"...","iterations":n,"ns_per_op":x, ...}
+
+malloc() is hooked while the benchmarks of the acquisition and
+processing paths run: any allocation there is reported and makes
+the run fail, see begin() in LSM9DS1.h. LSM9DS1_noalloc checks the
+same as a test.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <atomic>
+#include <vector>
+#include "LSM9DS1.h"
+#include "LSM9DS1_Simulator.h"
+#include "LSM9DS1_Motion.h"
+#include "LSM9DS1_TransportCounter.h"
+#include "LSM9DS1_Pipeline.h"
+#include "LSM9DS1_Log.h"
+#include "LSM9DS1_Block.h"
+#include "LSM9DS1_Latency.h"
+#include "LSM9DS1_AllocCounter.h"
+
+// Drives the acquisition without the timer
+class BenchIMU : public LSM9DS1 {
+public:
+	BenchIMU(LSM9DS1transport& transport) : LSM9DS1(transport) {}
+	void tick() {
+		timerEvent();
+	}
+};
+
+// Counts what arrives and measures how long it took to get here
+class BenchSink : public LSM9DS1sampleSink {
+public:
+	unsigned long n = 0;
+	LSM9DS1histogram latency;
+	bool measure = false;
+	virtual void hasSample(const LSM9DS1sample& sample) {
+		n++;
+		if (measure) latency.record(LSM9DS1latency::now() - sample.timestamp);
+	}
+};
+
+// Sums a channel of each block, a loop the compiler vectorises
+class BenchBlocks : public LSM9DS1blockConsumer {
+public:
+	long sum = 0;
+	unsigned long n = 0;
+	virtual void hasBlock(const LSM9DS1block& block) {
+		const int16_t* az = block.a[2];
+		for (unsigned i = 0; i < block.padded; i++) sum += az[i];
+		n += block.n;
+	}
+};
+
+// Integrates the gyro into an orientation, the simplest stand-in for
+// a fusion filter
+class BenchIntegrator : public LSM9DS1sampleSink {
+public:
+	BenchIntegrator(LSM9DS1& imu, double dt) : imu(imu), dt(dt) {}
+	double q[4] = {1, 0, 0, 0};
+	unsigned long n = 0;
+	virtual void hasSample(const LSM9DS1sample& sample) {
+		n++;
+		const double d2r = M_PI / 180;
+		const double wx = imu.calcGyro(sample.g[0]) * d2r;
+		const double wy = imu.calcGyro(sample.g[1]) * d2r;
+		const double wz = imu.calcGyro(sample.g[2]) * d2r;
+		const double r[4] = {
+			q[0] + 0.5 * dt * (-q[1] * wx - q[2] * wy - q[3] * wz),
+			q[1] + 0.5 * dt * (q[0] * wx + q[2] * wz - q[3] * wy),
+			q[2] + 0.5 * dt * (q[0] * wy - q[1] * wz + q[3] * wx),
+			q[3] + 0.5 * dt * (q[0] * wz + q[1] * wy - q[2] * wx)};
+		const double l = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + r[3] * r[3]);
+		for (int i = 0; i < 4; i++) q[i] = r[i] / l;
+	}
+private:
+	LSM9DS1& imu;
+	double dt;
+};
+
+class BenchCallback : public LSM9DS1callback {
+public:
+	float sum = 0;
+	virtual void hasSample(float gx, float gy, float gz,
+			       float ax, float ay, float az,
+			       float mx, float my, float mz) {
+		sum += gx + gy + gz + ax + ay + az + mx + my + mz;
+	}
+};
+
+static uint64_t now()
+{
+	return LSM9DS1latency::now();
+}
+
+static void report(const char* name, unsigned long iterations, uint64_t ns,
+		   const char* extra = "")
+{
+	printf("{\"name\":\"%s\",\"iterations\":%lu,\"ns_per_op\":%.1f%s}\n",
+	       name, iterations, (double)ns / iterations, extra);
+	fflush(stdout);
+}
+
+// Runs f n times and reports the time per run
+template<typename F> static void bench(const char* name, unsigned long n, F f)
+{
+	const unsigned long before = allocations;
+	armed = true;
+	const uint64_t t0 = now();
+	for (unsigned long i = 0; i < n; i++) f();
+	const uint64_t ns = now() - t0;
+	armed = false;
+	char extra[64];
+	snprintf(extra, sizeof(extra), ",\"allocations\":%lu", allocations - before);
+	report(name, n, ns, extra);
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned long n = 100000;
+	if (argc > 1) n = strtoul(argv[1], NULL, 10);
+
+	LSM9DS1simulator sim;
+	BenchIMU imu(sim);
+	BenchSink sink;
+	imu.setSampleSink(&sink);
+	imu.begin();
+	// Drive the acquisition by hand from here
+	imu.end();
+	sim.setManualClock(true);
+
+	// Bus
+	bench("register_read", n, [&]() { imu.getFIFOSamples(); });
+	bench("sample_9axis", n, [&]() {
+		imu.readGyro();
+		imu.readAccel();
+		imu.readMag();
+	});
+
+	// A timer event when polling, up to the sink
+	bench("timer_event", n, [&]() { imu.tick(); });
+
+	// FIFO streaming at 952 Hz, a timer event every 20 ms
+	imu.enableFIFOStreaming(G_ODR_952);
+	imu.tick();
+	sink.n = 0;
+	{
+		const unsigned long ticks = n / 20 + 1;
+		const unsigned long before = allocations;
+		armed = true;
+		const uint64_t t0 = now();
+		for (unsigned long i = 0; i < ticks; i++) {
+			sim.advance(20000000);
+			imu.tick();
+		}
+		const uint64_t ns = now() - t0;
+		armed = false;
+		char extra[96];
+		snprintf(extra, sizeof(extra), ",\"samples_per_s\":%.0f,\"allocations\":%lu",
+			 sink.n * 1e9 / ns, allocations - before);
+		report("fifo_drain_per_sample", sink.n, ns, extra);
+	}
+	imu.disableFIFOStreaming();
+
+	// Conversion to physical units
+	{
+		volatile float out = 0;
+		int16_t raw = 0;
+		bench("convert_9axis", n, [&]() {
+			raw += 7;
+			out = imu.calcGyro(raw) + imu.calcGyro(raw + 1) + imu.calcGyro(raw + 2) +
+				imu.calcAccel(raw) + imu.calcAccel(raw + 1) + imu.calcAccel(raw + 2) +
+				imu.calcMag(raw) + imu.calcMag(raw + 1) + imu.calcMag(raw + 2);
+		});
+		(void)out;
+	}
+	{
+		BenchCallback callback;
+		imu.setCallback(&callback);
+		bench("timer_event_with_callback", n, [&]() { imu.tick(); });
+		imu.setCallback(NULL);
+	}
+
+	// Processing: the library has no orientation fusion, so the stages
+	// shipped with it and the log codec stand in for it
+	LSM9DS1sample sample;
+	memset(&sample, 0, sizeof(sample));
+	{
+		LSM9DS1pipeline pipeline;
+		pipeline.add(new LSM9DS1lowpassStage(0.1f));
+		BenchSink out;
+		pipeline.setOutput(&out);
+		bench("lowpass_stage", n, [&]() {
+			sample.timestamp += 1000000;
+			sample.a[2]++;
+			pipeline.hasSample(sample);
+		});
+	}
+	{
+		LSM9DS1pipeline pipeline;
+		pipeline.add(new LSM9DS1oversampleStage(16));
+		BenchSink out;
+		pipeline.setOutput(&out);
+		bench("oversample_stage", n, [&]() {
+			sample.timestamp += 1000000;
+			sample.a[2]++;
+			pipeline.hasSample(sample);
+		});
+	}
+	{
+		BenchBlocks blocks;
+		LSM9DS1blockSink soa(&blocks, 32);
+		bench("soa_block_per_sample", n, [&]() {
+			sample.timestamp += 1000000;
+			sample.a[2]++;
+			soa.hasSample(sample);
+		});
+	}
+	{
+		std::vector<LSM9DS1sample> block(32);
+		for (unsigned i = 0; i < block.size(); i++) {
+			block[i] = sample;
+			block[i].timestamp += i * 1050000;
+			block[i].a[2] += i & 3;
+		}
+		std::vector<uint8_t> encoded(LSM9DS1logCodec::maxEncodedSize(32));
+		const unsigned long blocks = n / 32 + 1;
+		bench("log_encode_per_block_of_32", blocks, [&]() {
+			LSM9DS1logCodec::encode(block.data(), 32, encoded.data());
+		});
+	}
+
+	// End to end: from the start of the timer event to the sink
+	sink.measure = true;
+	sink.latency.reset();
+	{
+		const unsigned long before = allocations;
+		armed = true;
+		const uint64_t t0 = now();
+		for (unsigned long i = 0; i < n; i++) imu.tick();
+		const uint64_t ns = now() - t0;
+		armed = false;
+		char extra[160];
+		snprintf(extra, sizeof(extra),
+			 ",\"p50_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu,\"allocations\":%lu",
+			 (unsigned long long)sink.latency.percentile(50),
+			 (unsigned long long)sink.latency.percentile(99),
+			 (unsigned long long)sink.latency.getMax(), allocations - before);
+		report("end_to_end", n, ns, extra);
+	}
+
+	// A polling timer event through the counting transport: its
+	// overhead and what one event costs on the bus
+	{
+		LSM9DS1simulator countedSim;
+		LSM9DS1countingTransport counter(countedSim);
+		BenchIMU countedImu(counter);
+		BenchSink countedSink;
+		countedImu.setSampleSink(&countedSink);
+		countedImu.begin();
+		countedImu.end();
+		countedSim.setManualClock(true);
+		counter.reset();
+		const unsigned long before = allocations;
+		armed = true;
+		const uint64_t t0 = now();
+		for (unsigned long i = 0; i < n; i++) countedImu.tick();
+		const uint64_t ns = now() - t0;
+		armed = false;
+		const LSM9DS1countingTransport::Counts* c = counter.getCounts("timerEvent");
+		const double runs = c ? c->runs.load() : 1;
+		char extra[192];
+		snprintf(extra, sizeof(extra),
+			 ",\"est_syscalls_per_op\":%.1f,\"transactions_per_op\":%.1f,\"bytes_per_op\":%.1f"
+			 ",\"allocations\":%lu",
+			 c ? c->estimatedSyscalls.load() / runs : 0, c ? c->transactions.load() / runs : 0,
+			 c ? c->bytes.load() / runs : 0, allocations - before);
+		report("timer_event_counted", n, ns, extra);
+	}
+
+	// Orientation error and cost along a motion profile, FIFO streaming
+	// at 952 Hz: turns about z, then x, then rests
+	{
+		LSM9DS1motionSimulator motionSim;
+		BenchIMU motionImu(motionSim);
+		BenchIntegrator integrator(motionImu, 1 / 952.0);
+		motionImu.setSampleSink(&integrator);
+		motionImu.begin();
+		motionImu.end();
+		motionSim.setManualClock(true);
+		const float z[3] = {0, 0, 1}, x[3] = {1, 0, 0};
+		motionSim.addRotation(1, z, 90);
+		motionSim.addRotation(2, x, 45);
+		motionSim.addStatic(0.5);
+		motionImu.enableFIFOStreaming(G_ODR_952);
+		motionImu.tick();
+		integrator.q[0] = 1;
+		integrator.q[1] = integrator.q[2] = integrator.q[3] = 0;
+		motionSim.startProfile();
+		const uint64_t end = motionSim.now() + motionSim.getDuration();
+		integrator.n = 0;
+		const unsigned long before = allocations;
+		armed = true;
+		const uint64_t t0 = now();
+		while (motionSim.now() < end) {
+			motionSim.advance(20000000);
+			motionImu.tick();
+		}
+		const uint64_t ns = now() - t0;
+		armed = false;
+		float truth[4];
+		motionSim.truth(end, truth);
+		double dot = 0;
+		for (int i = 0; i < 4; i++) dot += truth[i] * integrator.q[i];
+		const double error = 2 * acos(fmin(1.0, fabs(dot))) * 180 / M_PI;
+		char extra[96];
+		snprintf(extra, sizeof(extra), ",\"orientation_error_deg\":%.3f,\"allocations\":%lu",
+			 error, allocations - before);
+		report("motion_gyro_integration", integrator.n, ns, extra);
+	}
+
+	if (allocations) {
+		fprintf(stderr, "%lu allocations in the acquisition or processing path\n",
+			(unsigned long)allocations);
+		return 1;
+	}
+	return 0;
+}
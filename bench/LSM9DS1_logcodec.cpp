@@ -0,0 +1,135 @@
+/******************************************************************************
+LSM9DS1_logcodec.cpp
+Test: samples come back bit-identical from the log codec and from a log
+file: gaps in the timestamps, flags, scale changes and channel deltas at
+the ends of the varint ranges, in blocks of 1 to maxBlockSamples.
+Fails with the number of wrong samples otherwise.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "LSM9DS1_Log.h"
+#include "LSM9DS1_Source.h"
+
+static bool same(const LSM9DS1sample& a, const LSM9DS1sample& b)
+{
+	if ((a.timestamp != b.timestamp) || (a.flags != b.flags) || (a.scale != b.scale))
+		return false;
+	for (int i = 0; i < 3; i++)
+		if ((a.g[i] != b.g[i]) || (a.a[i] != b.a[i]) || (a.m[i] != b.m[i]))
+			return false;
+	return true;
+}
+
+// Steady samples with the awkward cases mixed in
+static std::vector<LSM9DS1sample> makeSamples(unsigned n)
+{
+	const uint8_t scales[3] = {
+		LSM9DS1source::scaleCode(245, 2, 4),
+		LSM9DS1source::scaleCode(2000, 16, 16),
+		LSM9DS1source::scaleCode(500, 8, 12)
+	};
+	std::vector<LSM9DS1sample> samples(n);
+	uint64_t t = 1000000000ULL;
+	uint64_t random = 88172645463325252ULL;
+	for (unsigned j = 0; j < n; j++) {
+		LSM9DS1sample& s = samples[j];
+		memset(&s, 0, sizeof(s));
+		// 952 Hz with jitter, gaps and a long pause
+		t += 1050420 + (j % 7) * 13;
+		if (j % 97 == 50) t += 20000000;
+		if (j == n / 2) t += 3600000000000ULL;
+		s.timestamp = t;
+		s.scale = scales[(j / 40) % 3];
+		if ((j % 40 == 0) && j) s.flags |= SAMPLE_SCALE_CHANGE;
+		if (j % 97 == 50) s.flags |= SAMPLE_GAP;
+		if (j % 13 == 0) s.flags |= SAMPLE_ACCEL_INT;
+		int16_t* c[9] = {&s.g[0], &s.g[1], &s.g[2], &s.a[0], &s.a[1], &s.a[2],
+				 &s.m[0], &s.m[1], &s.m[2]};
+		for (int i = 0; i < 9; i++) {
+			random ^= random << 13;
+			random ^= random >> 7;
+			random ^= random << 17;
+			switch ((j + i) % 6) {
+			case 0:
+				// Full swings: deltas of +-65535 and +-32767
+				*c[i] = (j & 1) ? 32767 : -32768;
+				break;
+			case 1:
+				*c[i] = (j & 1) ? 32767 : 0;
+				break;
+			case 2:
+				*c[i] = (j & 1) ? 0 : -32767;
+				break;
+			default:
+				*c[i] = (int16_t)(random & 0xffff);
+			}
+		}
+	}
+	return samples;
+}
+
+int main(int, char **) {
+	unsigned long wrong = 0, checked = 0;
+
+	// Blocks of every awkward size straight through the codec
+	const unsigned sizes[] = {1, 2, 3, 31, 32, 33, 127, LSM9DS1logCodec::maxBlockSamples};
+	std::vector<LSM9DS1sample> decoded(LSM9DS1logCodec::maxBlockSamples);
+	for (unsigned n : sizes) {
+		const std::vector<LSM9DS1sample> samples = makeSamples(n);
+		std::vector<uint8_t> encoded(LSM9DS1logCodec::maxEncodedSize(n));
+		const size_t size = LSM9DS1logCodec::encode(samples.data(), n, encoded.data());
+		if ((size == 0) || (size > encoded.size()) ||
+		    (LSM9DS1logCodec::blockSize(encoded.data(), size) != size)) {
+			fprintf(stderr, "block of %u: %lu bytes\n", n, (unsigned long)size);
+			wrong++;
+			continue;
+		}
+		// A torn block must not decode
+		if (LSM9DS1logCodec::decode(encoded.data(), size - 1, decoded.data()) != 0) {
+			fprintf(stderr, "torn block of %u decoded\n", n);
+			wrong++;
+		}
+		if (LSM9DS1logCodec::decode(encoded.data(), size, decoded.data()) != n) {
+			fprintf(stderr, "block of %u did not decode\n", n);
+			wrong++;
+			continue;
+		}
+		for (unsigned j = 0; j < n; j++) {
+			if (!same(samples[j], decoded[j])) wrong++;
+			checked++;
+		}
+	}
+
+	// Through a log file, with the blocks ended by FIFO drains
+	const char* filename = "LSM9DS1_logcodec.log";
+	const std::vector<LSM9DS1sample> samples = makeSamples(5000);
+	{
+		IMUSettings settings;
+		LSM9DS1logWriter writer(filename, settings, 32, 1000000000, false);
+		for (unsigned j = 0; j < samples.size(); j++) {
+			writer.hasSample(samples[j]);
+			if (j % 21 == 20) writer.blockEnd();
+		}
+		if (writer.getWriteError()) wrong++;
+	}
+	LSM9DS1logReader reader(filename);
+	unsigned j = 0;
+	for (const LSM9DS1sample& s : reader) {
+		if ((j >= samples.size()) || !same(samples[j], s)) wrong++;
+		j++;
+		checked++;
+	}
+	if (j != samples.size()) {
+		fprintf(stderr, "%u of %u samples read back\n", j, (unsigned)samples.size());
+		wrong++;
+	}
+	remove(filename);
+	remove((std::string(filename) + ".idx").c_str());
+
+	printf("%lu samples checked, %lu wrong\n", checked, wrong);
+	return wrong ? 1 : 0;
+}
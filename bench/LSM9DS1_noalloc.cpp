@@ -0,0 +1,87 @@
+/******************************************************************************
+LSM9DS1_noalloc.cpp
+Test: the acquisition streams from the simulated chip without a single
+allocation after begin(), polling and with FIFO streaming, through a
+buffered sink, a pipeline, the callback, metrics and posted commands.
+Fails with the number of allocations otherwise.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <stdio.h>
+#include "LSM9DS1.h"
+#include "LSM9DS1_Simulator.h"
+#include "LSM9DS1_Buffer.h"
+#include "LSM9DS1_Pipeline.h"
+#include "LSM9DS1_Metrics.h"
+#include "LSM9DS1_AllocCounter.h"
+
+// Drives the acquisition without the timer
+class TestIMU : public LSM9DS1 {
+public:
+	TestIMU(LSM9DS1transport& transport) : LSM9DS1(transport) {}
+	void tick() {
+		timerEvent();
+	}
+};
+
+class TestSink : public LSM9DS1sampleSink {
+public:
+	std::atomic<unsigned long> n{0};
+	virtual void hasSample(const LSM9DS1sample&) {
+		n++;
+	}
+};
+
+class TestCallback : public LSM9DS1callback {
+public:
+	unsigned long n = 0;
+	virtual void hasSample(float, float, float, float, float, float, float, float, float) {
+		n++;
+	}
+};
+
+int main(int, char **) {
+	LSM9DS1simulator simulator;
+	TestIMU imu(simulator);
+	LSM9DS1metrics metrics;
+	imu.setMetrics(metrics);
+	TestSink sink;
+	LSM9DS1pipeline pipeline;
+	pipeline.add(new LSM9DS1lowpassStage(0.1f));
+	pipeline.setOutput(&sink);
+	LSM9DS1bufferedSink buffered(&pipeline);
+	TestCallback callback;
+	imu.setSampleSink(&buffered);
+	imu.setCallback(&callback);
+	imu.begin();
+	imu.end();
+	simulator.setManualClock(true);
+	imu.enableAutoRange(true, true);
+
+	unsigned long polling, streaming;
+	armed = true;
+	for (int i = 0; i < 1000; i++) {
+		simulator.advance(1000000);
+		if (i == 500) imu.postCommand(CMD_MAG_SCALE, 8);
+		imu.tick();
+	}
+	polling = allocations;
+	armed = false;
+
+	imu.enableFIFOStreaming();
+	armed = true;
+	for (int i = 0; i < 100; i++) {
+		simulator.advance(20000000);
+		if (i == 50) imu.postCommand(CMD_ACCEL_SCALE, 8);
+		imu.tick();
+	}
+	streaming = allocations - polling;
+	armed = false;
+	imu.disableFIFOStreaming();
+
+	printf("%lu samples, %lu allocations polling, %lu with FIFO streaming\n",
+	       callback.n, polling, streaming);
+	if ((polling + streaming) || (callback.n == 0)) return 1;
+	return 0;
+}
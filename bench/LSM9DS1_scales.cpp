@@ -0,0 +1,131 @@
+/******************************************************************************
+LSM9DS1_scales.cpp
+Test: samples reach the callback converted with the scales they were
+taken with when the scale changes while they are still pending, after
+a posted scale command, polling and with FIFO streaming, and after an
+auto-range switch while streaming.
+Fails with the number of wrong samples otherwise.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <stdio.h>
+#include <math.h>
+#include "LSM9DS1.h"
+#include "LSM9DS1_Simulator.h"
+
+// Drives the acquisition without the timer
+class TestIMU : public LSM9DS1 {
+public:
+	TestIMU(LSM9DS1transport& transport) : LSM9DS1(transport) {}
+	void tick() {
+		timerEvent();
+	}
+};
+
+// Counts the samples which are off by more than the tolerance
+class CheckCallback : public LSM9DS1callback {
+public:
+	float g[3], a[3];
+	float tolerance = 0.1f;
+	unsigned long n = 0, wrong = 0;
+	virtual void hasSample(float gx, float gy, float gz,
+			       float ax, float ay, float az,
+			       float, float, float) {
+		const float v[6] = {gx, gy, gz, ax, ay, az};
+		const float* expected[2] = {g, a};
+		bool ok = true;
+		for (int i = 0; i < 6; i++)
+			if (fabsf(v[i] - expected[i / 3][i % 3]) > tolerance) ok = false;
+		if (!ok) {
+			if (wrong < 5) fprintf(stderr, "got %f %f %f %f %f %f\n",
+					       gx, gy, gz, ax, ay, az);
+			wrong++;
+		}
+		n++;
+	}
+};
+
+// Counts the samples flagged with a new scale
+class ScaleSink : public LSM9DS1sampleSink {
+public:
+	unsigned long changes = 0;
+	virtual void hasSample(const LSM9DS1sample& sample) {
+		if (sample.flags & SAMPLE_SCALE_CHANGE) changes++;
+	}
+};
+
+int main(int, char **) {
+	LSM9DS1simulator simulator;
+	TestIMU imu(simulator);
+	CheckCallback callback;
+	ScaleSink sink;
+	imu.setSampleSink(&sink);
+	imu.begin();
+	imu.end();
+	simulator.setManualClock(true);
+	const float g[3] = {100, -50, 20};
+	const float a[3] = {0.5f, 0, -0.25f};
+	const float m[3] = {0.18f, 0, -0.45f};
+	simulator.setRest(g, a, m);
+	for (int i = 0; i < 3; i++) {
+		callback.g[i] = g[i];
+		callback.a[i] = a[i];
+	}
+	// The outputs read first were latched before setRest()
+	simulator.advance(10000000);
+	imu.tick();
+	imu.setCallback(&callback);
+
+	// Polling: the command is applied after the read of the same event
+	for (int i = 0; i < 100; i++) {
+		simulator.advance(10000000);
+		if (i == 50) imu.postCommand(CMD_GYRO_SCALE, 2000);
+		imu.tick();
+	}
+	const unsigned long pollingWrong = callback.wrong;
+
+	// FIFO streaming: the command is applied with entries pending
+	imu.enableFIFOStreaming(G_ODR_476);
+	for (int i = 0; i < 100; i++) {
+		simulator.advance(20000000);
+		if (i == 50) imu.postCommand(CMD_ACCEL_SCALE, 8);
+		imu.tick();
+	}
+	imu.disableFIFOStreaming();
+	const unsigned long streamingWrong = callback.wrong - pollingWrong;
+	const unsigned long commandChanges = sink.changes;
+
+	// Auto-range while streaming: the switch happens in the read, with
+	// the entries taken before it pending. 1.95 g is within 3% of the
+	// end of the 2 g range without saturating it.
+	imu.setAccelScale(2);
+	const float high[3] = {1.95f, 0, -0.25f};
+	simulator.setRest(g, high, m);
+	callback.a[0] = high[0];
+	simulator.advance(10000000);
+	imu.tick();
+	const unsigned long before = callback.wrong;
+	const unsigned long beforeChanges = sink.changes;
+	imu.enableAutoRange(true, false);
+	imu.enableFIFOStreaming(G_ODR_476);
+	for (int i = 0; i < 20; i++) {
+		simulator.advance(20000000);
+		imu.tick();
+	}
+	imu.disableFIFOStreaming();
+	imu.disableAutoRange();
+	const unsigned long autoRangeWrong = callback.wrong - before;
+	const unsigned long autoRangeChanges = sink.changes - beforeChanges;
+
+	printf("%lu samples, %lu wrong polling, %lu wrong with FIFO streaming, "
+	       "%lu wrong with auto-range\n",
+	       callback.n, pollingWrong, streamingWrong, autoRangeWrong);
+	if (callback.wrong || (callback.n == 0)) return 1;
+	if ((commandChanges != 2) || (autoRangeChanges == 0)) {
+		fprintf(stderr, "%lu scale changes after commands, %lu with auto-range\n",
+			commandChanges, autoRangeChanges);
+		return 1;
+	}
+	return 0;
+}
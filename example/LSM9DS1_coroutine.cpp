@@ -0,0 +1,56 @@
+/******************************************************************************
+LSM9DS1_coroutine.cpp
+A coroutine awaiting the samples of the simulated chip on a poll() loop.
+
+Distributed as-is; no warranty is given.
+******************************************************************************/
+
+#include <stdio.h>
+#include <poll.h>
+#include <coroutine>
+#include <exception>
+#include "LSM9DS1.h"
+#include "LSM9DS1_Simulator.h"
+#include "LSM9DS1_Async.h"
+
+// The smallest coroutine type: starts at once, nobody waits for it
+struct Task {
+	struct promise_type {
+		Task get_return_object() { return {}; }
+		std::suspend_never initial_suspend() { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+static bool finished = false;
+
+static Task printAccel(LSM9DS1asyncSink& samples, LSM9DS1& imu, unsigned n)
+{
+	while (n > 0) {
+		LSM9DS1sampleBatch batch = co_await samples.nextBatch();
+		for (const LSM9DS1sample& s : batch) {
+			printf("%llu: %f, %f, %f [g]\n", (unsigned long long)s.timestamp,
+			       imu.calcAccel(s.a[0]), imu.calcAccel(s.a[1]), imu.calcAccel(s.a[2]));
+			if (--n == 0) break;
+		}
+	}
+	finished = true;
+}
+
+int main() {
+	LSM9DS1simulator simulator;
+	LSM9DS1 imu(simulator);
+	LSM9DS1asyncSink samples;
+	imu.setSampleSink(&samples);
+	imu.begin();
+	printAccel(samples, imu, 20);
+	// The event loop of the application
+	struct pollfd fd = {samples.getFd(), POLLIN, 0};
+	while (!finished) {
+		if (poll(&fd, 1, -1) > 0) samples.dispatch();
+	}
+	imu.end();
+	return 0;
+}
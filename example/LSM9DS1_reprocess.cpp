@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "LSM9DS1_Log.h"
+#include "LSM9DS1_Batch.h"
+
+// The stages used by the live acquisition as well
+static void setupPipeline(LSM9DS1pipeline& pipeline) {
+	pipeline.add(new LSM9DS1lowpassStage(0.1));
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+	fprintf(stderr, "Usage: %s <output log> <input log> [<input log> ...]\n", argv[0]);
+	exit(EXIT_FAILURE);
+    }
+    std::vector<std::string> logs;
+    for (int i = 2; i < argc; i++) logs.push_back(argv[i]);
+
+    try {
+	// The output keeps the scales and rates of the first recording
+	IMUSettings settings;
+	{
+	    LSM9DS1logReader reader(argv[2]);
+	    const LSM9DS1logHeader& header = reader.getHeader();
+	    settings.gyro.scale = header.gyroScale;
+	    settings.accel.scale = header.accelScale;
+	    settings.mag.scale = header.magScale;
+	    settings.gyro.sampleRate = header.gyroSampleRate;
+	    settings.accel.sampleRate = header.accelSampleRate;
+	    settings.mag.sampleRate = header.magSampleRate;
+	}
+	LSM9DS1logWriter writer(argv[1], settings);
+	LSM9DS1batch batch(setupPipeline);
+	batch.setSampleSink(&writer);
+	unsigned long n = batch.run(logs);
+	printf("%lu samples reprocessed.\n", n);
+    } catch (const char* e) {
+	fprintf(stderr, "Error: %s\n", e);
+	exit(EXIT_FAILURE);
+    }
+    exit(EXIT_SUCCESS);
+}